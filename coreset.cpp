@@ -0,0 +1,121 @@
+#include "coreset.hpp"
+
+Coreset buildCoreset(const Dataset& data, size_t k, const CoresetOptions& options)
+{
+	size_t n = data.size();
+	size_t numThreads = max<size_t>(1, options.numThreads);
+	const double* w = (options.weights != nullptr) ? options.weights->data() : nullptr;
+	if (w != nullptr && options.weights->size() != n)
+		throw invalid_argument("got " + to_string(options.weights->size()) + " weights for " + to_string(n) + " points");
+	static mt19937 mt{random_device{}()};
+	Coreset coreset;
+
+	if (n <= options.size || k == 0)
+	{
+		coreset.points = data;
+		coreset.weights = (w != nullptr) ? *options.weights : vector<double>(n, 1.0);
+		KmeansPlusPlus seeding(data, k);
+		if (w != nullptr)
+			seeding.setWeights(coreset.weights);
+		seeding.initializeCentroids();
+		coreset.centers = seeding.getCentroids();
+		return coreset;
+	}
+
+	// cheap D^2 seeding on a uniform sample of the points (weighted by the weights of the sampled points)
+	PointStore sample;
+	vector<double> sampleWeights;
+	size_t sampleSize = min(n, max(options.seedSample, 10 * k));
+	uniform_int_distribution<size_t> uniformIndex(0, n - 1);
+	sample.reserve(sampleSize);
+	for (size_t s = 0; s < sampleSize; s++)
+	{
+		size_t i = uniformIndex(mt);
+		sample.push_back(data->xData()[i], data->yData()[i]);
+		if (w != nullptr)
+			sampleWeights.push_back(w[i]);
+	}
+	KmeansPlusPlus seeding(Dataset(move(sample)), k);
+	if (any_of(sampleWeights.begin(), sampleWeights.end(), [](double sw) { return sw > 0.0; }))
+		seeding.setWeights(move(sampleWeights));
+	seeding.initializeCentroids();
+	coreset.centers = seeding.getCentroids();
+	PointStore centerStore(coreset.centers);
+
+	// cost of every cluster of the seeds and its size (total weight)
+	LabelArray labels(n, k);
+	vector<ClusterSums> threadSums(numThreads);
+	vector<double> threadCost(numThreads, 0.0);
+	parallelForRanges(n, numThreads, [&](size_t t, size_t begin, size_t end) {
+		threadSums[t] = ClusterSums(k, w != nullptr);
+		labels.visit([&](auto* l) {
+			if (w == nullptr)
+			{
+				threadCost[t] = assignToNearestCentroid(*data, begin, end, centerStore, l, nullptr, &threadSums[t]);
+				return;
+			}
+			assignToNearestCentroid(*data, begin, end, centerStore, l);
+			double cost = 0.0;
+			for (size_t i = begin; i < end; i++)
+			{
+				double dx = data->xData()[i] - centerStore.xData()[l[i]];
+				double dy = data->yData()[i] - centerStore.yData()[l[i]];
+				threadSums[t].weight[l[i]] += w[i];
+				threadSums[t].count[l[i]]++;
+				cost += w[i] * (dx * dx + dy * dy);
+			}
+			threadCost[t] = cost;
+		});
+	}, "coreset");
+	reduceClusterSums(threadSums);
+	const ClusterSums& clusters = threadSums[0];
+	double cost = accumulate(threadCost.begin(), threadCost.end(), 0.0);
+	auto clusterSize = [&clusters](size_t a) { return clusters.weighted() ? clusters.weight[a] : double(clusters.count[a]); };
+
+	// the sensitivity bounds sum to 1 + the number of non-empty clusters (without the distance term if the cost is 0)
+	size_t nonEmpty = 0;
+	for (size_t a = 0; a < k; a++)
+		nonEmpty += clusterSize(a) > 0.0;
+	double total = nonEmpty + ((cost > 0.0) ? 1.0 : 0.0);
+
+	// sample every point independently, the expected size of the coreset is options.size
+	vector<uint32_t> threadSeeds(numThreads);
+	for (size_t t = 0; t < numThreads; t++)
+		threadSeeds[t] = mt();
+	vector<PointStore> threadPoints(numThreads);
+	vector<vector<double>> threadWeights(numThreads);
+	parallelForRanges(n, numThreads, [&](size_t t, size_t begin, size_t end) {
+		mt19937 threadMt(threadSeeds[t]);
+		uniform_real_distribution<> uniform(0.0, 1.0);
+		const double* x = data->xData();
+		const double* y = data->yData();
+		for (size_t i = begin; i < end; i++)
+		{
+			size_t a = labels[i];
+			double dx = x[i] - centerStore.xData()[a];
+			double dy = y[i] - centerStore.yData()[a];
+			double weight = (w != nullptr) ? w[i] : 1.0;
+			if (weight <= 0.0)
+				continue;
+			double sensitivity = 1.0 / clusterSize(a);
+			if (cost > 0.0)
+				sensitivity += (dx * dx + dy * dy) / cost;
+			double p = min(1.0, options.size * weight * sensitivity / total);
+			if (uniform(threadMt) < p)
+			{
+				threadPoints[t].push_back(x[i], y[i]);
+				threadWeights[t].push_back(weight / p);
+			}
+		}
+	}, "coreset");
+
+	PointStore points;
+	for (size_t t = 0; t < numThreads; t++)
+	{
+		for (size_t i = 0; i < threadPoints[t].size(); i++)
+			points.push_back(threadPoints[t].xData()[i], threadPoints[t].yData()[i]);
+		coreset.weights.insert(coreset.weights.end(), threadWeights[t].begin(), threadWeights[t].end());
+	}
+	coreset.points = Dataset(move(points));
+	return coreset;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <vector>
+
+#include "kmeans.hpp"
+
+using namespace std;
+
+// Settings of buildCoreset
+struct CoresetOptions {
+	size_t size = 4'096;			// expected number of weighted points
+	size_t seedSample = 65'536;		// uniform sample the D^2 seeding runs on
+	size_t numThreads = 1;
+	const vector<double>* weights = nullptr;	// weights of the input points (one per point), all weigh 1 if null
+};
+
+// Small weighted set of points whose weighted inertia approximates the inertia of the full data for any centroids
+struct Coreset {
+	Dataset points;
+	vector<double> weights;
+	vector<PointKmeans> centers;	// D^2 seeds the sensitivities were computed from, a good start for the fit
+};
+
+// Coreset by sensitivity sampling (Feldman and Langberg, 2011; Bachem et al., 2018)
+// k centers are seeded by Kmeans++ on a uniform sample, one pass over the data assigns the points to them
+// The sensitivity of a point is bounded by d^2 / cost + 1 / |cluster|, a second pass samples every point
+// independently with probability min(1, size * sensitivity / total) and weighs it by its inverse
+// Weighted input points count as that many copies: cost and cluster sizes are weighted, the sensitivity and the
+// output weight are multiplied by the weight of the point
+// Weighted kmeans over the coreset (Kmeans::setWeights) costs as much as over a few thousand points,
+// whatever the size of the data. A dataset of at most size points is returned whole with unit weights
+Coreset buildCoreset(const Dataset& data, size_t k, const CoresetOptions& options = CoresetOptions());
@@ -0,0 +1,206 @@
+#include "cpuTopology.hpp"
+
+#include <thread>
+#include <string>
+#include <vector>
+#include <set>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+using namespace std;
+
+#ifdef __linux__
+
+// Reads the first line of a file, empty if it does not exist
+static string readLine(const string& path)
+{
+	ifstream file(path);
+	string line;
+	getline(file, line);
+	return line;
+}
+
+// Paths from the cgroup of the process up to the root of the hierarchy
+static vector<string> cgroupAncestors(const string& mount, string path)
+{
+	vector<string> dirs;
+	while (true)
+	{
+		dirs.push_back(mount + path);
+		if (path.empty() || path == "/")
+			break;
+		size_t slash = path.find_last_of('/');
+		path = (slash == 0 || slash == string::npos) ? "/" : path.substr(0, slash);
+	}
+	return dirs;
+}
+
+// Quota of the cgroup v2 file cpu.max ("max 100000" or "<quota> <period>"), 0 if unlimited
+static double quotaV2(const string& dir)
+{
+	istringstream line(readLine(dir + "/cpu.max"));
+	string quota;
+	double period = 0.0;
+	if (!(line >> quota >> period) || quota == "max" || period <= 0.0)
+		return 0.0;
+	return stod(quota) / period;
+}
+
+// Quota of the cgroup v1 files cpu.cfs_quota_us and cpu.cfs_period_us (quota -1 means unlimited), 0 if unlimited
+static double quotaV1(const string& dir)
+{
+	string quota = readLine(dir + "/cpu.cfs_quota_us");
+	string period = readLine(dir + "/cpu.cfs_period_us");
+	if (quota.empty() || period.empty() || stod(quota) <= 0.0 || stod(period) <= 0.0)
+		return 0.0;
+	return stod(quota) / stod(period);
+}
+
+// The smallest quota of the cgroup of the process and its ancestors, 0 if there is none
+static double cgroupQuota()
+{
+	double quota = 0.0;
+	auto take = [&quota](double q) {
+		if (q > 0.0 && (quota == 0.0 || q < quota))
+			quota = q;
+	};
+
+	ifstream cgroups("/proc/self/cgroup");
+	string line;
+	while (getline(cgroups, line))
+	{
+		// hierarchy-id:controllers:path
+		size_t first = line.find(':');
+		size_t second = line.find(':', first + 1);
+		if (first == string::npos || second == string::npos)
+			continue;
+		string controllers = line.substr(first + 1, second - first - 1);
+		string path = line.substr(second + 1);
+
+		if (controllers.empty())
+		{
+			// cgroup v2 (unified hierarchy, mounted alone or under unified/ next to v1)
+			for (const string& mount : {string("/sys/fs/cgroup"), string("/sys/fs/cgroup/unified")})
+				for (const string& dir : cgroupAncestors(mount, path))
+					take(quotaV2(dir));
+			continue;
+		}
+
+		// cgroup v1 with the cpu controller
+		stringstream list(controllers);
+		string controller;
+		bool hasCpu = false;
+		while (getline(list, controller, ','))
+			hasCpu = hasCpu || controller == "cpu";
+		if (!hasCpu)
+			continue;
+		for (const string& mount : {string("/sys/fs/cgroup/cpu"), string("/sys/fs/cgroup/cpu,cpuacct"), string("/sys/fs/cgroup/cpuacct,cpu")})
+			for (const string& dir : cgroupAncestors(mount, path))
+				take(quotaV1(dir));
+	}
+	return quota;
+}
+
+#endif
+
+static CpuTopology probeCpuTopology()
+{
+	CpuTopology topology;
+	topology.logicalCpus = max<size_t>(1, thread::hardware_concurrency());
+	topology.affinityCpus = topology.logicalCpus;
+	topology.physicalCores = topology.logicalCpus;
+
+#ifdef __linux__
+	cpu_set_t mask;
+	CPU_ZERO(&mask);
+	if (sched_getaffinity(0, sizeof(mask), &mask) == 0)
+	{
+		topology.affinityCpus = max(1, CPU_COUNT(&mask));
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+			if (CPU_ISSET(cpu, &mask))
+				topology.affinityMask.push_back(cpu);
+
+		for (int node : parseCpuList(readLine("/sys/devices/system/node/possible")))
+		{
+			vector<int> cpus;
+			for (int cpu : parseCpuList(readLine("/sys/devices/system/node/node" + to_string(node) + "/cpulist")))
+				if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &mask))
+					cpus.push_back(cpu);
+			if (!cpus.empty())
+				topology.numaNodes.push_back(cpus);
+		}
+
+		// a core is identified by its package and its id inside the package
+		set<pair<int, int>> cores;
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+		{
+			if (!CPU_ISSET(cpu, &mask))
+				continue;
+			CpuInfo info;
+			info.cpu = cpu;
+			string dir = "/sys/devices/system/cpu/cpu" + to_string(cpu) + "/topology/";
+			string core = readLine(dir + "core_id");
+			string package = readLine(dir + "physical_package_id");
+			if (core.empty() || package.empty())
+			{
+				info.package = -1;
+				info.core = cpu;
+			}
+			else
+			{
+				info.package = stoi(package);
+				info.core = stoi(core);
+			}
+			for (size_t node = 0; node < topology.numaNodes.size(); node++)
+				if (find(topology.numaNodes[node].begin(), topology.numaNodes[node].end(), cpu) != topology.numaNodes[node].end())
+					info.node = node;
+			cores.insert({info.package, info.core});
+			topology.cpus.push_back(info);
+		}
+		topology.physicalCores = max<size_t>(1, cores.size());
+	}
+
+	topology.quotaCpus = cgroupQuota();
+#endif
+
+	if (topology.numaNodes.empty())
+		topology.numaNodes.push_back(vector<int>());	// unknown CPUs, threads on this node are not pinned
+
+	topology.usableThreads = topology.affinityCpus;
+	if (topology.quotaCpus > 0.0)
+		topology.usableThreads = min(topology.usableThreads, max<size_t>(1, (size_t)ceil(topology.quotaCpus)));
+	return topology;
+}
+
+vector<int> parseCpuList(const string& list)
+{
+	vector<int> cpus;
+	stringstream ranges(list);
+	string range;
+	while (getline(ranges, range, ','))
+	{
+		if (range.empty())
+			continue;
+		size_t dash = range.find('-');
+		int first = stoi(range.substr(0, dash));
+		int last = (dash == string::npos) ? first : stoi(range.substr(dash + 1));
+		if (first < 0 || last < first)
+			throw invalid_argument("invalid CPU range " + range);
+		for (int cpu = first; cpu <= last; cpu++)
+			cpus.push_back(cpu);
+	}
+	return cpus;
+}
+
+const CpuTopology& cpuTopology()
+{
+	static const CpuTopology topology = probeCpuTopology();
+	return topology;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <string>
+
+using namespace std;
+
+// A CPU of the affinity mask and where it is
+struct CpuInfo {
+	int cpu = 0;
+	int package = 0;	// physical package (socket)
+	int core = 0;		// core id inside the package, SMT siblings share it
+	size_t node = 0;	// index into CpuTopology::numaNodes
+};
+
+// CPUs available to the process
+// thread::hardware_concurrency() reports all CPUs of the machine, in a container or with a restricted affinity
+// the process can use only a part of them
+struct CpuTopology {
+	size_t logicalCpus = 1;		// hardware_concurrency (at least 1)
+	size_t affinityCpus = 1;	// CPUs in the affinity mask of the process (sched_getaffinity)
+	double quotaCpus = 0.0;		// cgroup v1/v2 CPU quota in CPUs, 0 if there is no quota
+	size_t physicalCores = 1;	// distinct cores among the CPUs of the affinity mask
+	size_t usableThreads = 1;	// affinity CPUs limited by the quota (rounded up), the default number of threads
+	vector<vector<int>> numaNodes;	// CPUs of the affinity mask on every NUMA node that has some (one node without NUMA)
+	vector<CpuInfo> cpus;			// CPUs of the affinity mask, empty if unknown (not on Linux)
+	vector<int> affinityMask;		// the affinity mask of the calling thread when it was probed (restored when it is unpinned)
+};
+
+// Reads the affinity mask, the cgroup quota, the core and the NUMA topology (on Linux, elsewhere only hardware_concurrency)
+// The result is probed once and cached
+const CpuTopology& cpuTopology();
+
+// Parses a CPU (or node) list such as "0-3,8-11", throws invalid_argument if it is malformed
+vector<int> parseCpuList(const string& list);
@@ -0,0 +1,168 @@
+#include "elkanKmeans.hpp"
+
+ElkanKmeans::ElkanKmeans(Dataset data, size_t k, vector<PointKmeans> centroids, size_t maxIter)
+: Kmeans(data, k, maxIter)
+{
+	this->centroids = centroids;
+}
+
+pair<vector<PointKmeans>, vector<vector<PointKmeans>>> ElkanKmeans::k_means()
+{
+	KmeansLabelResult res = this->k_meansLabels();
+	if (!res.converged)
+		return {vector<PointKmeans>(), vector<vector<PointKmeans>>()};
+
+	return {res.centroids, this->clustersFromLabels(res.labels)};
+}
+
+KmeansLabelResult ElkanKmeans::k_meansLabels()
+{
+	this->requireUnweighted("Elkan");
+
+	// initialize Centroids from given points
+	if (this->centroids.empty())
+		this->initializeCentroids();
+
+	size_t n = this->store.size();
+	size_t k = this->k;
+	const double* x = this->store->xData();
+	const double* y = this->store->yData();
+
+	KmeansLabelResult res;
+	res.labels = LabelArray(n, k);
+	res.sums = ClusterSums(k);
+	PointStore centroidStore(this->centroids);
+	PointStore oldCentroids(this->centroids);
+
+	vector<double> upper(n);
+	vector<double> lower(n * k);
+	vector<double> centroidDist(k * k);	// distances between the centroids
+	vector<double> halfClosest(k);			// half of the distance to the closest other centroid
+	vector<double> shift(k);				// how far each centroid moved in the last update
+
+	auto dist = [&](size_t i, size_t j) {
+		double dx = x[i] - centroidStore.xData()[j];
+		double dy = y[i] - centroidStore.yData()[j];
+		res.distanceEvaluations++;
+		return sqrt(dx * dx + dy * dy);
+	};
+
+	// first assignment computes the distance to each centroid and selects the minimal one
+	for (size_t i = 0; i < n; i++)
+	{
+		size_t best = 0;
+		for (size_t j = 0; j < k; j++)
+		{
+			lower[i * k + j] = dist(i, j);
+			if (lower[i * k + j] < lower[i * k + best])
+				best = j;
+		}
+		upper[i] = lower[i * k + best];
+		res.labels.set(i, best);
+	}
+
+	for (size_t iter = 0; iter < this->maxIter && !res.converged; iter++)
+	{
+		if (iter > 0)
+		{
+			// distances between the centroids
+			for (size_t a = 0; a < k; a++)
+			{
+				halfClosest[a] = numeric_limits<double>::max();
+				for (size_t b = 0; b < k; b++)
+				{
+					double dx = centroidStore.xData()[a] - centroidStore.xData()[b];
+					double dy = centroidStore.yData()[a] - centroidStore.yData()[b];
+					centroidDist[a * k + b] = sqrt(dx * dx + dy * dy);
+					if (a != b)
+						halfClosest[a] = min(halfClosest[a], 0.5 * centroidDist[a * k + b]);
+				}
+			}
+
+			// assign each point to a cluster, skipping centroids excluded by the bounds
+			for (size_t i = 0; i < n; i++)
+			{
+				size_t a = res.labels[i];
+				// no other centroid can be closer than half of the distance to the closest centroid
+				// (at equality a centroid with a lower index could tie, which Kmeans::k_means would take)
+				if (upper[i] < halfClosest[a])
+					continue;
+
+				// ties go to the lower index like in Kmeans::k_means, so a bound equal to upper excludes only
+				// the centroids after the current one
+				auto excluded = [&](size_t j, double bound) {
+					return (j < a) ? upper[i] < bound : upper[i] <= bound;
+				};
+
+				bool upperIsTight = false;
+				for (size_t j = 0; j < k; j++)
+				{
+					if (j == a || excluded(j, lower[i * k + j]) || excluded(j, 0.5 * centroidDist[a * k + j]))
+						continue;
+
+					// tighten the upper bound before computing the distance to another centroid
+					if (!upperIsTight)
+					{
+						upper[i] = dist(i, a);
+						lower[i * k + a] = upper[i];
+						upperIsTight = true;
+						if (excluded(j, lower[i * k + j]) || excluded(j, 0.5 * centroidDist[a * k + j]))
+							continue;
+					}
+
+					double d = dist(i, j);
+					lower[i * k + j] = d;
+					if (d < upper[i] || (d == upper[i] && j < a))
+					{
+						a = j;
+						upper[i] = d;
+					}
+				}
+				res.labels.set(i, a);
+			}
+		}
+
+		// calculate the sums of each cluster in the same order as Kmeans::k_means
+		res.sums.reset();
+		for (size_t i = 0; i < n; i++)
+		{
+			size_t a = res.labels[i];
+			res.sums.sumX[a] += x[i];
+			res.sums.sumY[a] += y[i];
+			res.sums.count[a]++;
+		}
+
+		// calculate new centroids and check if they are same as the previous centroids
+		copy(centroidStore.xData(), centroidStore.xData() + k, oldCentroids.xData());
+		copy(centroidStore.yData(), centroidStore.yData() + k, oldCentroids.yData());
+		res.converged = updateCentroids(res.sums, centroidStore);
+		res.iterations = iter + 1;
+
+		// move the bounds by the shift of the centroids
+		for (size_t j = 0; j < k; j++)
+		{
+			double dx = centroidStore.xData()[j] - oldCentroids.xData()[j];
+			double dy = centroidStore.yData()[j] - oldCentroids.yData()[j];
+			shift[j] = sqrt(dx * dx + dy * dy);
+		}
+		for (size_t i = 0; i < n; i++)
+		{
+			upper[i] += shift[res.labels[i]];
+			for (size_t j = 0; j < k; j++)
+			{
+				lower[i * k + j] = max(0.0, lower[i * k + j] - shift[j]);
+			}
+		}
+	}
+
+	if (!res.converged)
+		cout << "Elkan did not converge." << endl;
+
+	// sum of squared distances to the centroids of the last assignment
+	this->sqDist = sumOfSquaredDistances(*this->store, res.labels, oldCentroids);
+
+	this->centroids = centroidStore.toPoints();
+	res.centroids = this->centroids;
+	res.sqDist = this->sqDist;
+	return res;
+}
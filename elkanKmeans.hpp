@@ -0,0 +1,25 @@
+#pragma once
+#include <vector>
+
+#include "kmeans.hpp"
+
+using namespace std;
+
+// Kmeans accelerated with the triangle inequality (Elkan, 2003)
+// Keeps for every point an upper bound on the distance to its centroid and a lower bound on the distance to every centroid,
+// together with the distances between the centroids. A distance is computed only if the bounds cannot exclude the centroid,
+// so iterations in which almost no point changes its cluster cost O(n) instead of O(n*k) distances
+// Needs O(n*k) memory for the lower bounds
+// Gives the same centroids as Kmeans::k_means for the same initial centroids
+class ElkanKmeans : public Kmeans {
+
+public:
+
+	// Takes the initial centroids the same way as ParallelKmeans
+	ElkanKmeans(Dataset data, size_t k, vector<PointKmeans> centroids, size_t maxIter = 1'000);
+
+	pair<vector<PointKmeans>, vector<vector<PointKmeans>>> k_means() override;
+
+	KmeansLabelResult k_meansLabels() override;
+
+};
@@ -0,0 +1,206 @@
+#include "hamerlyKmeans.hpp"
+
+HamerlyKmeans::HamerlyKmeans(Dataset data, size_t k, vector<PointKmeans> centroids, size_t maxIter)
+: Kmeans(data, k, maxIter)
+{
+	this->centroids = centroids;
+}
+
+pair<vector<PointKmeans>, vector<vector<PointKmeans>>> HamerlyKmeans::k_means()
+{
+	KmeansLabelResult res = this->k_meansLabels();
+	if (!res.converged)
+		return {vector<PointKmeans>(), vector<vector<PointKmeans>>()};
+
+	return {res.centroids, this->clustersFromLabels(res.labels)};
+}
+
+void HamerlyKmeans::forEachPart(const function<void(size_t, size_t, size_t)>& f)
+{
+	f(0, 0, this->store.size());
+}
+
+size_t HamerlyKmeans::assignPart(size_t begin,
+									size_t end,
+									const PointStore& centroids,
+									const vector<double>& halfClosest,
+									bool first,
+									LabelArray& labels,
+									ClusterSums& sums)
+{
+	const double* x = this->store->xData();
+	const double* y = this->store->yData();
+	const double* cx = centroids.xData();
+	const double* cy = centroids.yData();
+	size_t evaluations = 0;
+
+	sums.reset();
+	for (size_t i = begin; i < end; i++)
+	{
+		size_t a = labels[i];
+
+		if (!first)
+		{
+			double bound = max(halfClosest[a], this->lower[i]);
+			if (this->upper[i] > bound)
+			{
+				// tighten the upper bound and check again
+				double dx = x[i] - cx[a];
+				double dy = y[i] - cy[a];
+				this->upper[i] = sqrt(dx * dx + dy * dy);
+				evaluations++;
+			}
+		}
+
+		if (first || this->upper[i] > max(halfClosest[a], this->lower[i]))
+		{
+			// compute distance to each centroid and keep the closest and the second closest one
+			double closest = numeric_limits<double>::max();
+			double second = numeric_limits<double>::max();
+			size_t closestIdx = 0;
+			for (size_t j = 0; j < this->k; j++)
+			{
+				double dx = x[i] - cx[j];
+				double dy = y[i] - cy[j];
+				double dist = dx * dx + dy * dy;
+				if (dist < closest)
+				{
+					second = closest;
+					closest = dist;
+					closestIdx = j;
+				}
+				else if (dist < second)
+				{
+					second = dist;
+				}
+			}
+			evaluations += this->k;
+
+			a = closestIdx;
+			labels.set(i, a);
+			this->upper[i] = sqrt(closest);
+			this->lower[i] = sqrt(second);
+		}
+
+		sums.sumX[a] += x[i];
+		sums.sumY[a] += y[i];
+		sums.count[a]++;
+	}
+	return evaluations;
+}
+
+void HamerlyKmeans::updateBoundsPart(size_t begin, size_t end, const vector<double>& shift, size_t maxShiftIdx, double maxShift, double secondMaxShift, const LabelArray& labels)
+{
+	for (size_t i = begin; i < end; i++)
+	{
+		size_t a = labels[i];
+		this->upper[i] += shift[a];
+		// the second closest centroid can be any centroid except the assigned one
+		this->lower[i] -= (a == maxShiftIdx) ? secondMaxShift : maxShift;
+	}
+}
+
+KmeansLabelResult HamerlyKmeans::k_meansLabels()
+{
+	this->requireUnweighted("Hamerly");
+
+	// initialize Centroids from given points
+	if (this->centroids.empty())
+		this->initializeCentroids();
+
+	size_t n = this->store.size();
+	size_t k = this->k;
+	size_t parts = this->numberOfParts();
+
+	KmeansLabelResult res;
+	res.labels = LabelArray(n, k);
+	res.sums = ClusterSums(k);
+	PointStore centroidStore(this->centroids);
+	PointStore oldCentroids(this->centroids);
+
+	this->upper.assign(n, 0.0);
+	this->lower.assign(n, 0.0);
+	vector<double> halfClosest(k);	// half of the distance to the closest other centroid
+	vector<double> shift(k);		// how far each centroid moved in the last update
+	vector<ClusterSums> partSums(parts, ClusterSums(k));
+	vector<size_t> partEvaluations(parts, 0);
+
+	for (size_t iter = 0; iter < this->maxIter && !res.converged; iter++)
+	{
+		for (size_t a = 0; a < k; a++)
+		{
+			halfClosest[a] = numeric_limits<double>::max();
+			for (size_t b = 0; b < k; b++)
+			{
+				if (a == b) continue;
+				double dx = centroidStore.xData()[a] - centroidStore.xData()[b];
+				double dy = centroidStore.yData()[a] - centroidStore.yData()[b];
+				halfClosest[a] = min(halfClosest[a], 0.5 * sqrt(dx * dx + dy * dy));
+			}
+		}
+
+		// assign each point to a cluster, skipping the points excluded by the bounds
+		bool first = iter == 0;
+		this->forEachPart([&](size_t part, size_t begin, size_t end) {
+			partEvaluations[part] = this->assignPart(begin, end, centroidStore, halfClosest, first, res.labels, partSums[part]);
+		});
+
+		res.sums.reset();
+		for (size_t part = 0; part < parts; part++)
+		{
+			res.sums.add(partSums[part]);
+			res.distanceEvaluations += partEvaluations[part];
+		}
+
+		// calculate new centroids and check if they are same as the previous centroids
+		copy(centroidStore.xData(), centroidStore.xData() + k, oldCentroids.xData());
+		copy(centroidStore.yData(), centroidStore.yData() + k, oldCentroids.yData());
+		res.converged = updateCentroids(res.sums, centroidStore);
+		res.iterations = iter + 1;
+
+		// move the bounds by the shift of the centroids
+		size_t maxShiftIdx = 0;
+		double maxShift = 0.0;
+		double secondMaxShift = 0.0;
+		for (size_t j = 0; j < k; j++)
+		{
+			double dx = centroidStore.xData()[j] - oldCentroids.xData()[j];
+			double dy = centroidStore.yData()[j] - oldCentroids.yData()[j];
+			shift[j] = sqrt(dx * dx + dy * dy);
+			if (shift[j] > maxShift)
+			{
+				secondMaxShift = maxShift;
+				maxShift = shift[j];
+				maxShiftIdx = j;
+			}
+			else if (shift[j] > secondMaxShift)
+			{
+				secondMaxShift = shift[j];
+			}
+		}
+		this->forEachPart([&](size_t, size_t begin, size_t end) {
+			this->updateBoundsPart(begin, end, shift, maxShiftIdx, maxShift, secondMaxShift, res.labels);
+		});
+	}
+
+	if (!res.converged)
+		cout << "Hamerly did not converge." << endl;
+
+	// sum of squared distances to the centroids of the last assignment
+	this->sqDist = sumOfSquaredDistances(*this->store, res.labels, oldCentroids);
+
+	this->centroids = centroidStore.toPoints();
+	res.centroids = this->centroids;
+	res.sqDist = this->sqDist;
+	return res;
+}
+
+size_t ParallelHamerlyKmeans::numberOfParts()
+{
+	return getNumThreads();
+}
+
+void ParallelHamerlyKmeans::forEachPart(const function<void(size_t, size_t, size_t)>& f)
+{
+	parallelForRanges(this->store.size(), this->numberOfParts(), f, "hamerly");
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <vector>
+#include <functional>
+
+#include "kmeans.hpp"
+
+using namespace std;
+
+// Kmeans accelerated with one upper and one lower bound per point (Hamerly, 2010)
+// The upper bound is on the distance to the assigned centroid, the lower bound on the distance to the second closest centroid
+// A point is skipped while its upper bound is below the lower bound or below half of the distance
+// from its centroid to the closest other centroid
+// Needs only 16 bytes per point, so it is the better choice than Elkan for low k
+class HamerlyKmeans : public Kmeans {
+
+public:
+
+	// Takes the initial centroids the same way as ParallelKmeans
+	HamerlyKmeans(Dataset data, size_t k, vector<PointKmeans> centroids, size_t maxIter = 1'000);
+
+	pair<vector<PointKmeans>, vector<vector<PointKmeans>>> k_means() override;
+
+	KmeansLabelResult k_meansLabels() override;
+
+protected:
+
+	vector<double> upper;
+	vector<double> lower;
+
+	// Number of parts the points are split into, each part has its own sums
+	virtual size_t numberOfParts() { return 1; };
+
+	// Calls f(part, begin, end) for every part of the points
+	virtual void forEachPart(const function<void(size_t, size_t, size_t)>& f);
+
+	// Assigns points [begin, end) to their nearest centroid and adds them to sums
+	// Returns the number of computed distances
+	size_t assignPart(size_t begin,
+						size_t end,
+						const PointStore& centroids,
+						const vector<double>& halfClosest,
+						bool first,
+						LabelArray& labels,
+						ClusterSums& sums);
+
+	// Moves the bounds of points [begin, end) by the shift of the centroids
+	void updateBoundsPart(size_t begin, size_t end, const vector<double>& shift, size_t maxShiftIdx, double maxShift, double secondMaxShift, const LabelArray& labels);
+};
+
+// Multi-threaded version of HamerlyKmeans
+// Points are split between threads the same way as in ParallelKmeans, every thread keeps its own cluster sums
+class ParallelHamerlyKmeans : public HamerlyKmeans {
+
+public:
+
+	ParallelHamerlyKmeans(Dataset data, size_t k, vector<PointKmeans> centroids, size_t maxIter = 1'000)
+	: HamerlyKmeans(data, k, centroids, maxIter) {};
+
+protected:
+
+	size_t numberOfParts() override;
+
+	void forEachPart(const function<void(size_t, size_t, size_t)>& f) override;
+};
@@ -0,0 +1,423 @@
+#include "kdTreeKmeans.hpp"
+
+KdTreeKmeans::KdTreeKmeans(Dataset data, size_t k, vector<PointKmeans> centroids, size_t maxIter, size_t leafSize)
+: Kmeans(data, k, maxIter)
+{
+	this->centroids = centroids;
+	this->leafSize = max<size_t>(1, leafSize);
+}
+
+pair<vector<PointKmeans>, vector<vector<PointKmeans>>> KdTreeKmeans::k_means()
+{
+	KmeansLabelResult res = this->k_meansLabels();
+	if (!res.converged)
+		return {vector<PointKmeans>(), vector<vector<PointKmeans>>()};
+
+	return {res.centroids, this->clustersFromLabels(res.labels)};
+}
+
+size_t KdTreeKmeans::countNodes(size_t n)
+{
+	if (n <= this->leafSize)
+		return 1;
+	return 1 + this->countNodes(n / 2) + this->countNodes(n - n / 2);
+}
+
+void KdTreeKmeans::buildTree()
+{
+	size_t n = this->store.size();
+	this->order.resize(n);
+	iota(this->order.begin(), this->order.end(), 0);
+	this->nodes.assign(this->countNodes(n), KdNode());
+
+	// the larger half is always on the right, so the deepest leaf is on the rightmost path
+	this->depth = 1;
+	for (size_t m = n; m > this->leafSize; m -= m / 2)
+		this->depth++;
+
+	// top levels of the tree are built in parallel, one subtree per thread
+	size_t parallelDepth = 0;
+	while ((size_t(1) << parallelDepth) < this->numberOfParts())
+		parallelDepth++;
+
+	// nodes at parallelDepth are built as separate tasks of the pool
+	vector<BuildTask> tasks;
+	if (n > 0)
+		this->buildNode(0, 0, n, 0, parallelDepth, &tasks);
+	ThreadPool::global().run(tasks.size(), [&](size_t t) {
+		this->buildNode(tasks[t].node, tasks[t].begin, tasks[t].end, parallelDepth, parallelDepth, nullptr);
+	}, "kd-tree build");
+}
+
+void KdTreeKmeans::buildNode(size_t node, size_t begin, size_t end, size_t level, size_t parallelDepth, vector<BuildTask>* tasks)
+{
+	if (tasks != nullptr && level == parallelDepth)
+	{
+		tasks->push_back({node, begin, end});
+		return;
+	}
+
+	const double* x = this->store->xData();
+	const double* y = this->store->yData();
+	KdNode& nd = this->nodes[node];
+
+	// the levels above parallelDepth hold most of the points, so their scans and splits use all threads
+	size_t numThreads = (tasks != nullptr) ? this->numberOfParts() : 1;
+	this->scanNode(nd, begin, end, numThreads);
+	nd.begin = begin;
+	nd.end = end;
+	nd.right = 0;
+
+	if (end - begin <= this->leafSize)
+		return;
+
+	// split the wider side of the box at the median
+	size_t mid = begin + (end - begin) / 2;
+	const double* coord = (nd.maxX - nd.minX >= nd.maxY - nd.minY) ? x : y;
+	this->selectMedian(begin, mid, end, coord, numThreads);
+
+	size_t left = node + 1;
+	size_t right = left + this->countNodes(mid - begin);
+	nd.right = right;
+
+	this->buildNode(left, begin, mid, level + 1, parallelDepth, tasks);
+	this->buildNode(right, mid, end, level + 1, parallelDepth, tasks);
+}
+
+void KdTreeKmeans::scanNode(KdNode& nd, size_t begin, size_t end, size_t numThreads)
+{
+	const double* x = this->store->xData();
+	const double* y = this->store->yData();
+
+	// bounding box and sums of the points of the node, every thread scans a part of the range
+	auto scan = [&](KdNode& part, size_t first, size_t last) {
+		part.minX = part.minY = numeric_limits<double>::max();
+		part.maxX = part.maxY = numeric_limits<double>::lowest();
+		part.sumX = part.sumY = part.sumSq = 0.0;
+		for (size_t p = first; p < last; p++)
+		{
+			size_t i = this->order[p];
+			part.minX = min(part.minX, x[i]);
+			part.maxX = max(part.maxX, x[i]);
+			part.minY = min(part.minY, y[i]);
+			part.maxY = max(part.maxY, y[i]);
+			part.sumX += x[i];
+			part.sumY += y[i];
+			part.sumSq += x[i] * x[i] + y[i] * y[i];
+		}
+	};
+
+	if (numThreads <= 1)
+	{
+		scan(nd, begin, end);
+	}
+	else
+	{
+		vector<KdNode> parts(numThreads);
+		parallelForRanges(end - begin, numThreads, [&](size_t t, size_t first, size_t last) {
+			scan(parts[t], begin + first, begin + last);
+		}, "kd-tree build");
+
+		nd = parts[0];
+		for (size_t t = 1; t < numThreads; t++)
+		{
+			nd.minX = min(nd.minX, parts[t].minX);
+			nd.maxX = max(nd.maxX, parts[t].maxX);
+			nd.minY = min(nd.minY, parts[t].minY);
+			nd.maxY = max(nd.maxY, parts[t].maxY);
+			nd.sumX += parts[t].sumX;
+			nd.sumY += parts[t].sumY;
+			nd.sumSq += parts[t].sumSq;
+		}
+	}
+	nd.count = end - begin;
+}
+
+void KdTreeKmeans::selectMedian(size_t begin, size_t mid, size_t end, const double* coord, size_t numThreads)
+{
+	auto less = [coord](uint32_t a, uint32_t b) { return coord[a] < coord[b]; };
+
+	// quickselect with parallel three-way partitions until the range around mid is small enough for one thread
+	vector<uint32_t> buffer;
+	size_t lo = begin;
+	size_t hi = end;
+	while (numThreads > 1 && hi - lo > 65'536)
+	{
+		size_t n = hi - lo;
+
+		// pivot is the median of an evenly spaced sample
+		vector<uint32_t> sample(64);
+		for (size_t s = 0; s < sample.size(); s++)
+			sample[s] = this->order[lo + s * (n / sample.size())];
+		nth_element(sample.begin(), sample.begin() + sample.size() / 2, sample.end(), less);
+		double pivot = coord[sample[sample.size() / 2]];
+
+		// every thread counts its smaller, equal and greater points and moves them to their place in the buffer
+		vector<size_t> smaller(numThreads), equal(numThreads), greater(numThreads);
+		parallelForRanges(n, numThreads, [&](size_t t, size_t first, size_t last) {
+			for (size_t p = lo + first; p < lo + last; p++)
+			{
+				double c = coord[this->order[p]];
+				if (c < pivot)
+					smaller[t]++;
+				else if (c == pivot)
+					equal[t]++;
+			}
+			greater[t] = last - first - smaller[t] - equal[t];
+		}, "kd-tree build");
+
+		size_t numSmaller = accumulate(smaller.begin(), smaller.end(), size_t(0));
+		size_t numEqual = accumulate(equal.begin(), equal.end(), size_t(0));
+		size_t offsets[3] = {0, numSmaller, numSmaller + numEqual};
+		vector<array<size_t, 3>> starts(numThreads);
+		for (size_t t = 0; t < numThreads; t++)
+		{
+			starts[t] = {offsets[0], offsets[1], offsets[2]};
+			offsets[0] += smaller[t];
+			offsets[1] += equal[t];
+			offsets[2] += greater[t];
+		}
+
+		buffer.resize(n);
+		parallelForRanges(n, numThreads, [&](size_t t, size_t first, size_t last) {
+			array<size_t, 3> next = starts[t];
+			for (size_t p = lo + first; p < lo + last; p++)
+			{
+				double c = coord[this->order[p]];
+				size_t side = (c < pivot) ? 0 : ((c == pivot) ? 1 : 2);
+				buffer[next[side]++] = this->order[p];
+			}
+		}, "kd-tree build");
+		parallelForRanges(n, numThreads, [&](size_t, size_t first, size_t last) {
+			copy(buffer.begin() + first, buffer.begin() + last, this->order.begin() + lo + first);
+		}, "kd-tree build");
+
+		if (mid < lo + numSmaller)
+			hi = lo + numSmaller;
+		else if (mid < lo + numSmaller + numEqual)
+			return;
+		else
+			lo += numSmaller + numEqual;
+	}
+
+	nth_element(this->order.begin() + lo, this->order.begin() + mid, this->order.begin() + hi, less);
+}
+
+void KdTreeKmeans::assignNode(const KdNode& node, size_t c, const PointStore& centroids, FilterState& state)
+{
+	double cx = centroids.xData()[c];
+	double cy = centroids.yData()[c];
+
+	state.sums.sumX[c] += node.sumX;
+	state.sums.sumY[c] += node.sumY;
+	state.sums.count[c] += node.count;
+	// sum of ||p - c||^2 over the node expanded, so the points are not needed
+	state.sqDist += node.sumSq - 2.0 * (cx * node.sumX + cy * node.sumY) + node.count * (cx * cx + cy * cy);
+
+	if (state.labels)
+	{
+		for (size_t p = node.begin; p < node.end; p++)
+			state.labels->set(this->order[p], c);
+	}
+}
+
+void KdTreeKmeans::filter(size_t node,
+							size_t level,
+							size_t numCandidates,
+							const PointStore& centroids,
+							FilterState& state,
+							size_t taskDepth,
+							vector<FilterTask>* tasks)
+{
+	const KdNode& nd = this->nodes[node];
+	const uint32_t* candidates = &state.candidates[level * this->k];
+	const double* cx = centroids.xData();
+	const double* cy = centroids.yData();
+
+	if (numCandidates == 1)
+	{
+		this->assignNode(nd, candidates[0], centroids, state);
+		return;
+	}
+
+	if (tasks != nullptr && level == taskDepth)
+	{
+		tasks->push_back({node, level, vector<uint32_t>(candidates, candidates + numCandidates)});
+		return;
+	}
+
+	if (nd.right == 0)
+	{
+		// leaf - compute distance of each point to each candidate and select the minimal one
+		const double* x = this->store->xData();
+		const double* y = this->store->yData();
+		for (size_t p = nd.begin; p < nd.end; p++)
+		{
+			size_t i = this->order[p];
+			double min = numeric_limits<double>::max();
+			size_t minIdx = candidates[0];
+			for (size_t c = 0; c < numCandidates; c++)
+			{
+				double dx = x[i] - cx[candidates[c]];
+				double dy = y[i] - cy[candidates[c]];
+				double dist = dx * dx + dy * dy;
+				if (dist < min)
+				{
+					min = dist;
+					minIdx = candidates[c];
+				}
+			}
+			state.sums.sumX[minIdx] += x[i];
+			state.sums.sumY[minIdx] += y[i];
+			state.sums.count[minIdx]++;
+			state.sqDist += min;
+			if (state.labels)
+				state.labels->set(i, minIdx);
+		}
+		state.evaluations += nd.count * numCandidates;
+		return;
+	}
+
+	// candidate closest to the center of the box
+	double midX = 0.5 * (nd.minX + nd.maxX);
+	double midY = 0.5 * (nd.minY + nd.maxY);
+	size_t best = candidates[0];
+	double bestDist = numeric_limits<double>::max();
+	for (size_t c = 0; c < numCandidates; c++)
+	{
+		double dx = midX - cx[candidates[c]];
+		double dy = midY - cy[candidates[c]];
+		double dist = dx * dx + dy * dy;
+		if (dist < bestDist)
+		{
+			bestDist = dist;
+			best = candidates[c];
+		}
+	}
+	state.evaluations += numCandidates;
+
+	// drop the candidates that are further than the best one from every point of the box
+	// it is enough to check the corner of the box in the direction from the best candidate to the other one
+	uint32_t* next = &state.candidates[(level + 1) * this->k];
+	size_t numNext = 0;
+	for (size_t c = 0; c < numCandidates; c++)
+	{
+		size_t z = candidates[c];
+		if (z != best)
+		{
+			double vx = (cx[z] > cx[best]) ? nd.maxX : nd.minX;
+			double vy = (cy[z] > cy[best]) ? nd.maxY : nd.minY;
+			double dz = (cx[z] - vx) * (cx[z] - vx) + (cy[z] - vy) * (cy[z] - vy);
+			double dBest = (cx[best] - vx) * (cx[best] - vx) + (cy[best] - vy) * (cy[best] - vy);
+			if (dz >= dBest)
+				continue;
+		}
+		next[numNext++] = static_cast<uint32_t>(z);
+	}
+
+	this->filter(node + 1, level + 1, numNext, centroids, state, taskDepth, tasks);
+	this->filter(nd.right, level + 1, numNext, centroids, state, taskDepth, tasks);
+}
+
+void KdTreeKmeans::assign(const PointStore& centroids, ClusterSums& sums, LabelArray* labels, size_t& evaluations, double& sqDist)
+{
+	size_t numThreads = this->numberOfParts();
+
+	FilterState top;
+	top.sums = ClusterSums(this->k);
+	top.labels = labels;
+	top.candidates.resize((this->depth + 1) * this->k);
+	iota(top.candidates.begin(), top.candidates.begin() + this->k, 0);
+
+	if (numThreads <= 1)
+	{
+		this->filter(0, 0, this->k, centroids, top, 0, nullptr);
+	}
+	else
+	{
+		// the top of the tree is filtered here, the subtrees below taskDepth are split between the threads
+		size_t taskDepth = 0;
+		while ((size_t(1) << taskDepth) < 4 * numThreads && taskDepth + 1 < this->depth)
+			taskDepth++;
+
+		vector<FilterTask> tasks;
+		this->filter(0, 0, this->k, centroids, top, taskDepth, &tasks);
+
+		vector<FilterState> states(numThreads);
+		parallelForRanges(numThreads, numThreads, [&](size_t t, size_t, size_t) {
+			FilterState& state = states[t];
+			state.sums = ClusterSums(this->k);
+			state.labels = labels;
+			state.candidates.resize((this->depth + 1) * this->k);
+			for (size_t task = t; task < tasks.size(); task += numThreads)
+			{
+				copy(tasks[task].candidates.begin(), tasks[task].candidates.end(), state.candidates.begin() + tasks[task].depth * this->k);
+				this->filter(tasks[task].node, tasks[task].depth, tasks[task].candidates.size(), centroids, state, 0, nullptr);
+			}
+		}, "kd-tree filter");
+
+		for (FilterState& state : states)
+		{
+			top.sums.add(state.sums);
+			top.evaluations += state.evaluations;
+			top.sqDist += state.sqDist;
+		}
+	}
+
+	sums = top.sums;
+	evaluations = top.evaluations;
+	sqDist = top.sqDist;
+}
+
+KmeansLabelResult KdTreeKmeans::k_meansLabels()
+{
+	this->requireUnweighted("Kd-tree");
+
+	// initialize Centroids from given points
+	if (this->centroids.empty())
+		this->initializeCentroids();
+
+	// the tree is built only once and reused by every run
+	if (this->nodes.empty())
+		this->buildTree();
+
+	KmeansLabelResult res;
+	res.labels = LabelArray(this->store.size(), this->k);
+	res.sums = ClusterSums(this->k);
+	PointStore centroidStore(this->centroids);
+	PointStore oldCentroids(this->centroids);
+
+	for (size_t iter = 0; iter < this->maxIter && !res.converged; iter++)
+	{
+		// assign the nodes of the tree to the clusters
+		size_t evaluations = 0;
+		this->assign(centroidStore, res.sums, nullptr, evaluations, this->sqDist);
+		res.distanceEvaluations += evaluations;
+
+		// calculate new centroids and check if they are same as the previous centroids
+		copy(centroidStore.xData(), centroidStore.xData() + this->k, oldCentroids.xData());
+		copy(centroidStore.yData(), centroidStore.yData() + this->k, oldCentroids.yData());
+		res.converged = updateCentroids(res.sums, centroidStore);
+		res.iterations = iter + 1;
+	}
+
+	if (!res.converged)
+		cout << "Kd-tree kmeans did not converge." << endl;
+
+	// the labels are written only once, by repeating the last assignment
+	ClusterSums lastSums;
+	size_t evaluations = 0;
+	double sqDist = 0.0;
+	this->assign(oldCentroids, lastSums, &res.labels, evaluations, sqDist);
+	res.distanceEvaluations += evaluations;
+
+	this->centroids = centroidStore.toPoints();
+	res.centroids = this->centroids;
+	res.sqDist = this->sqDist;
+	return res;
+}
+
+size_t ParallelKdTreeKmeans::numberOfParts()
+{
+	return getNumThreads();
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <vector>
+#include <array>
+
+#include "kmeans.hpp"
+
+using namespace std;
+
+// Kmeans with the filtering algorithm over a kd-tree (Kanungo et al., 2002)
+// The tree is built once over the points, every node keeps the bounding box, sums and number of its points
+// During the assignment candidates are filtered top-down: a centroid is dropped for a node if it is further
+// than the centroid closest to the box center from every corner of the box
+// Once a single candidate is left, the whole subtree is added to its cluster without touching the points,
+// so on clustered data an iteration costs about O(k*log n) instead of O(n*k)
+// Works only with 2D space
+class KdTreeKmeans : public Kmeans {
+
+public:
+
+	// Takes the initial centroids the same way as ParallelKmeans
+	// leafSize is the maximal number of points in a leaf of the tree
+	KdTreeKmeans(Dataset data, size_t k, vector<PointKmeans> centroids, size_t maxIter = 1'000, size_t leafSize = 16);
+
+	pair<vector<PointKmeans>, vector<vector<PointKmeans>>> k_means() override;
+
+	KmeansLabelResult k_meansLabels() override;
+
+protected:
+
+	struct KdNode {
+		double minX, maxX, minY, maxY;	// bounding box
+		double sumX, sumY, sumSq;		// sums of the coordinates and of the squared norms
+		size_t count;
+		size_t begin, end;				// range of the node in order
+		size_t right;					// index of the right child (left child follows its parent), 0 for leaves
+	};
+
+	// Output of the filtering of a part of the tree
+	struct FilterState {
+		ClusterSums sums;
+		LabelArray* labels = nullptr;	// labels are written only if not null
+		vector<uint32_t> candidates;	// candidates of every level of the recursion
+		size_t evaluations = 0;
+		double sqDist = 0.0;
+	};
+
+	// Subtree with its candidates that is filtered by one thread
+	struct FilterTask {
+		size_t node;
+		size_t depth;
+		vector<uint32_t> candidates;
+	};
+
+	// Subtree over order[begin, end) with its root at nodes[node] that is built by one thread
+	struct BuildTask {
+		size_t node;
+		size_t begin;
+		size_t end;
+	};
+
+	vector<KdNode> nodes;
+	vector<uint32_t> order;		// indices of the points in the order of the tree
+	size_t leafSize;
+	size_t depth = 0;			// depth of the tree
+
+	// Number of threads used for the tree build and the traversal
+	virtual size_t numberOfParts() { return 1; };
+
+	void buildTree();
+
+	// Number of nodes of a tree over n points
+	size_t countNodes(size_t n);
+
+	// Builds the subtree over order[begin, end) with its root at nodes[node]
+	// Nodes at parallelDepth are not built, but added to tasks (if tasks is not null)
+	void buildNode(size_t node, size_t begin, size_t end, size_t level, size_t parallelDepth, vector<BuildTask>* tasks);
+
+	// Bounding box, sums and count of the points order[begin, end) computed by numThreads threads
+	void scanNode(KdNode& nd, size_t begin, size_t end, size_t numThreads);
+
+	// Reorders order[begin, end) so that order[mid] is the point that would be there if sorted by coord,
+	// with no larger point before it and no smaller after it
+	void selectMedian(size_t begin, size_t mid, size_t end, const double* coord, size_t numThreads);
+
+	// Filters the candidates of a node and adds its points to the clusters in state
+	// Nodes at taskDepth are not filtered, but added to tasks (if tasks is not null)
+	void filter(size_t node,
+				size_t level,
+				size_t numCandidates,
+				const PointStore& centroids,
+				FilterState& state,
+				size_t taskDepth,
+				vector<FilterTask>* tasks);
+
+	// Adds all points of a node to cluster c
+	void assignNode(const KdNode& node, size_t c, const PointStore& centroids, FilterState& state);
+
+	// One assignment over the tree, returns the merged sums and the sum of squared distances
+	void assign(const PointStore& centroids, ClusterSums& sums, LabelArray* labels, size_t& evaluations, double& sqDist);
+};
+
+// KdTreeKmeans with the tree built and traversed by multiple threads
+// The top levels of the tree are built one node after another, each with scans and median splits over all threads,
+// the subtrees below them are built by one thread each
+class ParallelKdTreeKmeans : public KdTreeKmeans {
+
+public:
+
+	ParallelKdTreeKmeans(Dataset data, size_t k, vector<PointKmeans> centroids, size_t maxIter = 1'000, size_t leafSize = 16)
+	: KdTreeKmeans(data, k, centroids, maxIter, leafSize) {};
+
+protected:
+
+	size_t numberOfParts() override;
+};
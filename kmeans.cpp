@@ -11,23 +11,25 @@ bool PointKmeans::equal(PointKmeans& p) {
 	return diff < 0.0001;
 }
 
-Kmeans::Kmeans(vector<PointKmeans> points, size_t k, size_t maxIter)
+Kmeans::Kmeans(Dataset data, size_t k, size_t maxIter)
 {
-	this->points = points;
+	this->store = data;
 	this->k = k;
 	this->maxIter = maxIter;
 	this->centroids = vector<PointKmeans>();
 }
 
 // Euclidian distance without the square root
-double squaredEuclidianDist(PointKmeans p1, PointKmeans p2){
-	return pow(p1.getX() - p2.getX(), 2.0) + pow(p1.getY() - p2.getY(), 2.0);
+double squaredEuclidianDist(const PointKmeans& p1, const PointKmeans& p2){
+	double dx = p1.getX() - p2.getX();
+	double dy = p1.getY() - p2.getY();
+	return dx * dx + dy * dy;
 }
 
 void Kmeans::initializeCentroids()
 {
 	
-	if (this->points.empty()) {
+	if (this->store.empty()) {
 		cout << "No points to initialize centroids." << endl;
 		return;
 	}
@@ -35,18 +37,59 @@ void Kmeans::initializeCentroids()
 
 	this->centroids = vector<PointKmeans>(this->k);
 
-	// shuffle the points
-	vector<size_t> indices = vector<size_t>(this->points.size());
-	iota(indices.begin(), indices.end(), 0);
+	// take k random points
+	vector<size_t> indices = this->randomPointIndices(this->k);
+	for (size_t i = 0; i < this->k; i++)
+	{
+		this->centroids[i] = this->store->at(indices[i]);
+	}
+
+}
+
+// Throws if the weights are given and there is not one per point
+static void checkWeights(const vector<double>* weights, size_t n)
+{
+	if (weights != nullptr && weights->size() != n)
+		throw invalid_argument("got " + to_string(weights->size()) + " weights for " + to_string(n) + " points");
+}
+
+void Kmeans::setWeights(shared_ptr<const vector<double>> weights)
+{
+	if (weights && !weights->empty())
+		checkWeights(weights.get(), this->store.size());
+	this->weights = (weights && !weights->empty()) ? weights : nullptr;
+}
+
+void Kmeans::requireUnweighted(const string& name) const
+{
+	if (this->weights)
+		throw invalid_argument(name + " kmeans does not support weighted points");
+}
+
+vector<size_t> Kmeans::randomPointIndices(size_t count)
+{
 	static mt19937 mt{random_device{}()};
-	shuffle(indices.begin(), indices.end(), mt);
+	vector<size_t> indices = vector<size_t>(this->store.size());
+	iota(indices.begin(), indices.end(), 0);
 
-	// take k first elements in the shuffled array
-	for (size_t i = 0; i < this->k; i++)
+	// shuffle the points and take the first ones
+	if (!this->weights)
 	{
-		this->centroids[i] = this->points[indices[i]];
+		shuffle(indices.begin(), indices.end(), mt);
+		indices.resize(min(count, indices.size()));
+		return indices;
 	}
 
+	// weighted sampling without replacement (Efraimidis and Spirakis): the points with the largest log(u) / weight
+	const vector<double>& w = *this->weights;
+	uniform_real_distribution<> uniform(0.0, 1.0);
+	vector<double> keys(indices.size());
+	for (size_t i = 0; i < keys.size(); i++)
+		keys[i] = (w[i] > 0.0) ? log(uniform(mt)) / w[i] : -numeric_limits<double>::infinity();
+	count = min(count, indices.size());
+	partial_sort(indices.begin(), indices.begin() + count, indices.end(), [&keys](size_t a, size_t b) { return keys[a] > keys[b]; });
+	indices.resize(count);
+	return indices;
 }
 
 vector<vector<PointKmeans>> Kmeans::initializeCentroidsForMultipleTrials(size_t nTrials)
@@ -55,17 +98,12 @@ vector<vector<PointKmeans>> Kmeans::initializeCentroidsForMultipleTrials(size_t
 
 	for (size_t i = 0; i < nTrials; i++)
 	{
-		// shuffle the points
-		vector<size_t> indices = vector<size_t>(this->points.size());
-		iota(indices.begin(), indices.end(), 0);
-		static mt19937 mt{random_device{}()};
-		shuffle(indices.begin(), indices.end(), mt);
-
-		// take k first elements in the shuffled array
+		// take k random points
+		vector<size_t> indices = this->randomPointIndices(this->k);
 		vector<PointKmeans> centroids(this->k);
 		for (size_t j = 0; j < this->k; j++)
 		{
-			centroids[j] = this->points[indices[j]];
+			centroids[j] = this->store->at(indices[j]);
 		}
 
 		initCentroids[i] = centroids;
@@ -81,33 +119,29 @@ pair<vector<PointKmeans>, vector<vector<PointKmeans>>> Kmeans::k_means()
 	if (this->centroids.empty())
 		this->initializeCentroids();
 
+	// weighted means need the weights of the points, which the copies in the clusters do not have
+	if (this->weights)
+	{
+		KmeansLabelResult res = this->k_meansLabels();
+		if (!res.converged)
+			return {vector<PointKmeans>(), vector<vector<PointKmeans>>()};
+		return {res.centroids, this->clustersFromLabels(res.labels)};
+	}
+
 	bool converged = true;
+	vector<uint32_t> labels(this->store.size());
 
 	for (size_t i = 0; i < this->maxIter; i++)
 	{
-		sqDist = 0.0;
 		vector<vector<PointKmeans>> clusters = vector<vector<PointKmeans>>(this->k, vector<PointKmeans>());
 		vector<PointKmeans> newCentroids = vector<PointKmeans>(this->k);
 
 		// assign each point to a cluster
-		for (PointKmeans &point : this->points)
+		// the kernel computes the distance to each centroid and selects the minimal one
+		sqDist = assignToNearestCentroid(*this->store, 0, this->store.size(), PointStore(this->centroids), labels.data());
+		for (size_t p = 0; p < this->store.size(); p++)
 		{
-
-			double min = numeric_limits<double>::max();
-			size_t minIdx = 0;
-
-			// compute distance to each centroid and select the minimal one
-			for (size_t j = 0; j < this->k; j++)
-			{
-				double dist = squaredEuclidianDist(point, this->centroids[j]);
-				if (dist < min)
-				{
-					sqDist += dist;
-					min = dist;
-					minIdx = j;
-				}
-			}
-			clusters[minIdx].push_back(point);
+			clusters[labels[p]].push_back(this->store->at(p));
 		}
 
 		// calculate new centroids - calculate mean for each cluster
@@ -124,7 +158,12 @@ pair<vector<PointKmeans>, vector<vector<PointKmeans>>> Kmeans::k_means()
 				sumY += p.getY();
 			}
 
-			// compute the mean of all points in a cluster
+			// compute the mean of all points in a cluster, an empty cluster keeps its centroid (as in updateCentroids)
+			if (clusters[j].empty())
+			{
+				newCentroids[j] = this->centroids[j];
+				continue;
+			}
 			double meanX = sumX / clusters[j].size();
 			double meanY = sumY / clusters[j].size();
 			
@@ -148,170 +187,210 @@ pair<vector<PointKmeans>, vector<vector<PointKmeans>>> Kmeans::k_means()
 		return {vector<PointKmeans>(), vector<vector<PointKmeans>>()};
 }
 
-tuple<double, vector<PointKmeans>, vector<vector<PointKmeans>>> Kmeans::k_meansForParallel(vector<PointKmeans> c)
+KmeansLabelResult Kmeans::k_meansLabels()
 {
-	double minSqDist;
-	vector<PointKmeans> finalCentroids;
-	vector<vector<PointKmeans>> finalClusters;
-
-	bool converged = true;
-
-	for (size_t i = 0; i < this->maxIter; i++)
-	{
-		minSqDist = 0.0;
-		vector<vector<PointKmeans>> clusters = vector<vector<PointKmeans>>(this->k, vector<PointKmeans>());
-		vector<PointKmeans> newCentroids = vector<PointKmeans>(this->k);
-
-		// assign each point to a cluster
-		for (PointKmeans &point : this->points)
-		{
+	// initialize Centroids from given points
+	if (this->centroids.empty())
+		this->initializeCentroids();
 
-			double min = numeric_limits<double>::max();
-			size_t minIdx = 0;
+	FitOptions options;
+	options.maxIter = this->maxIter;
+	options.weights = this->weightsOrNull();
+	KmeansLabelResult res = fit(this->store, this->centroids, options);
 
-			// compute distance to each centroid and select the minimal one
-			for (size_t j = 0; j < this->k; j++)
-			{
-				double dist = squaredEuclidianDist(point, c[j]);
-				if (dist < min)
-				{
-					minSqDist += dist;
-					min = dist;
-					minIdx = j;
-				}
-			}
+	if (!res.converged)
+		cout << "Did not converge." << endl;
 
-			clusters[minIdx].push_back(point);
-		}
+	this->centroids = res.centroids;
+	this->sqDist = res.sqDist;
+	return res;
+}
 
-		// calculate new centroids - calculate mean for each cluster
-		// and check if the new centroids are same as the previous centroids
-		for (size_t j = 0; j < this->k; j++)
+// Assigns the points of [begin, end) to their nearest centroids and adds them to sums multiplied by their weights
+// The range is processed in tiles, so the labels and coordinates of a tile are still cached when its sums are added
+// Returns the weighted sum of the squared distances
+template <typename Label>
+static double assignWeighted(const PointStore& points, size_t begin, size_t end, const PointStore& centroids,
+							const double* weights, Label* labels, ClusterSums& sums)
+{
+	const size_t tileSize = 4'096;
+	const double* x = points.xData();
+	const double* y = points.yData();
+	const double* cx = centroids.xData();
+	const double* cy = centroids.yData();
+
+	double sum = 0.0;
+	for (size_t tile = begin; tile < end; tile += tileSize)
+	{
+		size_t tileEnd = min(end, tile + tileSize);
+		assignToNearestCentroid(points, tile, tileEnd, centroids, labels);
+		for (size_t i = tile; i < tileEnd; i++)
 		{
-
-			double sumX = 0.0;
-			double sumY = 0.0;
-
-			for (auto p : clusters[j])
-			{
-				sumX += p.getX();
-				sumY += p.getY();
-			}
-
-			// compute the mean of all points in a cluster
-			double meanX = sumX / clusters[j].size();
-			double meanY = sumY / clusters[j].size();
-			
-			newCentroids[j] = PointKmeans(meanX, meanY);
-			double diff = abs(newCentroids[j].getX() - c[j].getX()) + abs(newCentroids[j].getY() - c[j].getY());
-			if (diff > 0.0001)
-				converged = false;
+			size_t a = labels[i];
+			double w = weights[i];
+			double dx = x[i] - cx[a];
+			double dy = y[i] - cy[a];
+			sums.sumX[a] += w * x[i];
+			sums.sumY[a] += w * y[i];
+			sums.weight[a] += w;
+			sums.count[a]++;
+			sum += w * (dx * dx + dy * dy);
 		}
+	}
+	return sum;
+}
 
-		if (converged)
+KmeansLabelResult fit(const Dataset& data, const vector<PointKmeans>& initCentroids, const FitOptions& options)
+{
+	size_t n = data.size();
+	size_t k = initCentroids.size();
+	size_t numThreads = max<size_t>(1, options.numThreads);
+	checkWeights(options.weights, n);
+	const double* weights = (options.weights != nullptr) ? options.weights->data() : nullptr;
+
+	KmeansLabelResult res;
+	res.labels = LabelArray(n, k);
+	PointStore centroidStore(initCentroids);
+
+	// every thread accumulates its part of the points into its own sums
+	// allocated by the threads, so in the NUMA mode they are first touched on the node of their thread
+	vector<ClusterSums> threadSums(numThreads);
+	vector<double> threadSqDist(numThreads, 0.0);
+
+	double previousSqDist = numeric_limits<double>::max();
+	for (size_t iter = 0; iter < options.maxIter && !res.converged; iter++)
+	{
+		// assign each point to a cluster and add it to the sums of the cluster
+		parallelForRanges(n, numThreads, [&](size_t t, size_t start, size_t end) {
+			if (threadSums[t].size() != k)
+				threadSums[t] = ClusterSums(k, weights != nullptr);
+			else
+				threadSums[t].reset();
+			res.labels.visit([&](auto* labels) {
+				if (weights != nullptr)
+					threadSqDist[t] = assignWeighted(*data, start, end, centroidStore, weights, labels, threadSums[t]);
+				else
+					threadSqDist[t] = assignToNearestCentroid(*data, start, end, centroidStore, labels, nullptr, &threadSums[t]);
+			});
+		}, "assignment");
+
+		// merge the sums of all threads
+		reduceClusterSums(threadSums);
+		res.sums = threadSums[0];
+		res.sqDist = accumulate(threadSqDist.begin(), threadSqDist.end(), 0.0);
+
+		// calculate new centroids and check if they are same as the previous centroids
+		res.converged = updateCentroids(res.sums, centroidStore, options.tolerance);
+		res.iterations = iter + 1;
+		res.distanceEvaluations += n * k;
+
+		if (!res.converged && options.race != nullptr && options.race->hopeless(res.iterations, res.sqDist, previousSqDist))
 		{
-			finalCentroids = newCentroids;
-			finalClusters = clusters;
+			res.abandoned = true;
 			break;
 		}
-		else {
-			converged = true; // set converged to default value
-			c = newCentroids;
-		}
-	}
-	if(!converged){
-		minSqDist = numeric_limits<double>::max();
-		finalCentroids = vector<PointKmeans>();
-		finalClusters = vector<vector<PointKmeans>>();
-		cout << "Did not converge." << endl;
+		previousSqDist = res.sqDist;
 	}
 
-	return {minSqDist, finalCentroids, finalClusters};
+	res.centroids = centroidStore.toPoints();
+	if (options.race != nullptr)
+		options.race->finished(res);
+	return res;
+}
+
+vector<vector<PointKmeans>> Kmeans::clustersFromLabels(const LabelArray& labels)
+{
+	vector<vector<PointKmeans>> clusters(this->k);
+	for (size_t i = 0; i < labels.size(); i++)
+	{
+		clusters[labels[i]].push_back(this->store->at(i));
+	}
+	return clusters;
 }
 
 pair<vector<PointKmeans>, vector<vector<PointKmeans>>> Kmeans::k_meansMultipleTrials(size_t nTrials, vector<vector<PointKmeans>> initCentroids){
 
-	double minSqDist = numeric_limits<double>::max();
-	vector<PointKmeans> bestCentroids;
-	vector<vector<PointKmeans>> finalClusters;
+	FitOptions options;
+	options.maxIter = this->maxIter;
+	options.weights = this->weightsOrNull();
 
 	// run all trials of kmeans
+	vector<KmeansLabelResult> results(nTrials);
 	for (size_t i = 0; i < nTrials; i++)
 	{
-		this->centroids.clear();
-		this->centroids = initCentroids[i];
-		auto res = this->k_means();
-		// select the best solution
-		if (this->sqDist < minSqDist)
-		{
-			minSqDist = this->sqDist;
-			bestCentroids = res.first;
-			finalClusters = res.second;
-		}
+		results[i] = fit(this->store, initCentroids[i], options);
 	}
-	return {bestCentroids, finalClusters};
+	return this->bestTrial(results);
 }
 
-pair<vector<PointKmeans>, vector<vector<PointKmeans>>> Kmeans::k_meansParallelMultipleTrials(size_t nTrials, vector<vector<PointKmeans>> initCentroids)
+// CPU time of all threads of the process, the trials fan out over the pool so their wall time says little
+static double processCpuSeconds()
 {
-	double minSqDist = numeric_limits<double>::max();
-    vector<PointKmeans> bestCentroids;
-	vector<vector<PointKmeans>> finalClusters;
-
-    // Number of threads to use
-    size_t numThreads = (thread::hardware_concurrency() < nTrials) ? thread::hardware_concurrency() : nTrials;
-
-    vector<thread> threads(numThreads);
-    vector< tuple< double, vector<PointKmeans>, vector<vector<PointKmeans>>>> results(nTrials);
-
-	// function for running a single trial
-    auto trialFunction = [this, &results, &initCentroids](size_t trial_index) {
-        this->centroids.clear();
-        auto res = this->k_meansForParallel(initCentroids[trial_index]);
-        results[trial_index] = make_tuple(get<0>(res), get<1>(res), get<2>(res));
-    };
+	return static_cast<double>(clock()) / CLOCKS_PER_SEC;
+}
 
-    // Launch the threads for each trial
-    for (size_t i = 0; i < nTrials; i++)
-    {
-		// if there are more centroids than threads - reuse the threads
-        if (i >= numThreads)
-        {
-            threads[i % numThreads].join();
-        }
+pair<vector<PointKmeans>, vector<vector<PointKmeans>>> Kmeans::k_meansParallelMultipleTrials(size_t nTrials, vector<vector<PointKmeans>> initCentroids, TrialRace* race)
+{
+	FitOptions options;
+	options.maxIter = this->maxIter;
+	options.race = race;
+	options.weights = this->weightsOrNull();
+	// the assignment of a trial is split into chunks, which idle threads steal when there are fewer trials than threads
+	// or when the other trials already finished
+	options.numThreads = ThreadPool::global().size();
+
+	// every trial is one task of the pool, the trials share the dataset and write only their own result
+	vector<KmeansLabelResult> results(nTrials);
+	double start = processCpuSeconds();
+	ThreadPool::global().run(nTrials, [this, &results, &initCentroids, &options](size_t trial_index) {
+		results[trial_index] = fit(this->store, initCentroids[trial_index], options);
+	}, "trials");
+	if (race != nullptr)
+		race->addCpuSeconds(processCpuSeconds() - start);
+
+	return this->bestTrial(results);
+}
 
-        threads[i % numThreads] = thread(trialFunction, i);
-    }
+pair<vector<PointKmeans>, vector<vector<PointKmeans>>> Kmeans::k_meansBatchedMultipleTrials(size_t nTrials, vector<vector<PointKmeans>> initCentroids, size_t numThreads, TrialRace* race)
+{
+	FitOptions options;
+	options.maxIter = this->maxIter;
+	options.numThreads = numThreads;
+	options.race = race;
+	options.weights = this->weightsOrNull();
+
+	initCentroids.resize(nTrials);
+	double start = processCpuSeconds();
+	vector<KmeansLabelResult> results = fitTrials(this->store, initCentroids, options);
+	if (race != nullptr)
+		race->addCpuSeconds(processCpuSeconds() - start);
+	return this->bestTrial(results);
+}
 
-    // Ensure all threads are joined before proceeding
-    for (size_t i = 0; i < numThreads; ++i)
-    {
-		// Check if the thread is joinable before joining
-        if (threads[i].joinable())  
-        {
-            threads[i].join();
-        }
-    }
+pair<vector<PointKmeans>, vector<vector<PointKmeans>>> Kmeans::bestTrial(const vector<KmeansLabelResult>& results)
+{
+	// select the converged trial with the smallest sum of squared distances
+	const KmeansLabelResult* best = nullptr;
+	for (const KmeansLabelResult& res : results)
+	{
+		if (!res.converged && !res.abandoned)
+			cout << "Did not converge." << endl;
+		else if (res.converged && (best == nullptr || res.sqDist < best->sqDist))
+			best = &res;
+	}
 
-    // Find the best output
-    for (const auto& result : results)
-    {
-        if (get<0>(result) < minSqDist)
-        {
-            minSqDist = get<0>(result);
-            bestCentroids = get<1>(result);
-			finalClusters = get<2>(result);
-        }
-    }
+	if (best == nullptr)
+		return {vector<PointKmeans>(), vector<vector<PointKmeans>>()};
 
-    return {bestCentroids, finalClusters};
+	this->centroids = best->centroids;
+	this->sqDist = best->sqDist;
+	return {best->centroids, this->clustersFromLabels(best->labels)};
 }
 
 
 
 
-
-ParallelKmeans::ParallelKmeans(vector<PointKmeans> data, size_t k, vector<PointKmeans> centroids, size_t maxIter)
+ParallelKmeans::ParallelKmeans(Dataset data, size_t k, vector<PointKmeans> centroids, size_t maxIter)
 : Kmeans(data, k, maxIter)
 {
 	this->centroids = centroids;
@@ -319,157 +398,503 @@ ParallelKmeans::ParallelKmeans(vector<PointKmeans> data, size_t k, vector<PointK
 
 pair<vector<PointKmeans>, vector<vector<PointKmeans>>> ParallelKmeans::k_means()
 {
-	size_t numThreads = thread::hardware_concurrency();
-    atomic<bool> converged(true);
-
-    for (size_t iter = 0; iter < this->maxIter; iter++)
-    {
-		vector<thread> threads(numThreads);
-        vector<vector<PointKmeans>> clusters(this->k);
-        mutex clusterMutex;
-
-        vector<PointKmeans> newCentroids(this->k);
-
-        // Parallel point assignment to each cluster
-        for (size_t t = 0; t < numThreads; ++t)
-        {
-            size_t pointsPerThread = this->points.size() / numThreads;
-            size_t start = t * pointsPerThread;
-            size_t end = (t == numThreads - 1) ? this->points.size() : start + pointsPerThread;
-
-            threads[t] = thread([this, start, end, &clusters, &clusterMutex, t]() {
-                for (size_t i = start; i < end; ++i)
-                {
-                    PointKmeans& point = this->points[i];
-                    double minDist = numeric_limits<double>::max();
-                    size_t bestCluster = 0;
-
-					// compute distance to each centroid and select the minimal one
-                    for (size_t j = 0; j < this->k; ++j)
-                    {
-						double dist = squaredEuclidianDist(point, this->centroids[j]);
-                        if (dist < minDist)
-                        {
-                            minDist = dist;
-                            bestCluster = j;
-                        }
-                    }
-
-                    lock_guard<mutex> lock(clusterMutex);
-                    clusters[bestCluster].push_back(point);
-                }
-            });
-        }
-
-        for (auto& thread : threads)
-        {
-            thread.join();
-        }
-
-
-        // Parallel computation of new centroids
-        threads.resize(numThreads);
-        converged.store(true, std::memory_order_relaxed);
-
-        for (size_t t = 0; t < numThreads; ++t)
-        {
-            threads[t] = thread([t, numThreads, &clusters, &newCentroids, &converged, this]() {
-                for (size_t j = t; j < this->k; j += numThreads)
-                {
-                    double sumX = 0.0;
-                    double sumY = 0.0;
-
-                    for (auto& p : clusters[j])
-                    {
-                        sumX += p.getX();
-                        sumY += p.getY();
-                    }
-
-					// compute the mean of all points in a cluster
-                    if (!clusters[j].empty())
-                    {
-                        double meanX = sumX / clusters[j].size();
-                        double meanY = sumY / clusters[j].size();
-                        newCentroids[j] = PointKmeans(meanX, meanY);
-
-                        double diff = abs(newCentroids[j].getX() - this->centroids[j].getX()) +
-                                      abs(newCentroids[j].getY() - this->centroids[j].getY());
-                        if (diff > 0.0001)
-                        {
-                            converged.store(false, std::memory_order_relaxed);
-                        }
-                    }
-                    else
-                    {
-                        newCentroids[j] = this->centroids[j];
-                    }
-                }
-            });
-        }
-
-        for (auto& thread : threads)
-        {
-            thread.join();
-        }
-
-        // Check for convergence
-        if (converged.load(std::memory_order_relaxed))
-        {
-			return {newCentroids, clusters};
-        }
-        else
-        {
-            this->centroids = newCentroids;
-        }
-    }
-
-    if (!converged.load(std::memory_order_relaxed))
-        cout << "Parallel did not converge." << endl;
+	// the points are not copied into the clusters until the run has converged
+	KmeansLabelResult res = this->k_meansLabels();
+	if (!res.converged)
 		return {vector<PointKmeans>(), vector<vector<PointKmeans>>()};
+
+	return {res.centroids, this->clustersFromLabels(res.labels)};
+}
+
+KmeansLabelResult ParallelKmeans::k_meansLabels()
+{
+	FitOptions options;
+	options.maxIter = this->maxIter;
+	options.numThreads = getNumThreads();
+	options.weights = this->weightsOrNull();
+	KmeansLabelResult res = fit(this->store, this->centroids, options);
+
+	if (!res.converged)
+		cout << "Parallel did not converge." << endl;
+
+	this->centroids = res.centroids;
+	this->sqDist = res.sqDist;
+	return res;
+}
+
+vector<KmeansLabelResult> fitTrials(const Dataset& data, const vector<vector<PointKmeans>>& initCentroids, const FitOptions& options)
+{
+	size_t n = data.size();
+	size_t nTrials = initCentroids.size();
+	size_t numThreads = max<size_t>(1, options.numThreads);
+	const size_t tileSize = 512;	// 8 KB of coordinates, stays in L1 while all trials are assigned
+	checkWeights(options.weights, n);
+	const double* weights = (options.weights != nullptr) ? options.weights->data() : nullptr;
+
+	vector<KmeansLabelResult> results(nTrials);
+	vector<PointStore> centroidStores(nTrials);
+	vector<vector<ClusterSums>> threadSums(nTrials);	// sums of every thread for every trial
+	vector<vector<double>> threadSqDist(nTrials, vector<double>(numThreads, 0.0));
+	vector<double> previousSqDist(nTrials, numeric_limits<double>::max());
+	vector<size_t> active;
+	for (size_t trial = 0; trial < nTrials; trial++)
+	{
+		size_t k = initCentroids[trial].size();
+		results[trial].labels = LabelArray(n, k);
+		centroidStores[trial] = PointStore(initCentroids[trial]);
+		threadSums[trial].assign(numThreads, ClusterSums(k, weights != nullptr));
+		active.push_back(trial);
+	}
+
+	for (size_t iter = 0; iter < options.maxIter && !active.empty(); iter++)
+	{
+		// every tile of points is loaded once and assigned for all active trials
+		parallelForRanges(n, numThreads, [&](size_t t, size_t start, size_t end) {
+			for (size_t trial : active)
+			{
+				threadSums[trial][t].reset();
+				threadSqDist[trial][t] = 0.0;
+			}
+			for (size_t tile = start; tile < end; tile += tileSize)
+			{
+				size_t tileEnd = min(end, tile + tileSize);
+				for (size_t trial : active)
+				{
+					results[trial].labels.visit([&](auto* labels) {
+						if (weights != nullptr)
+							threadSqDist[trial][t] += assignWeighted(*data, tile, tileEnd, centroidStores[trial], weights, labels, threadSums[trial][t]);
+						else
+							threadSqDist[trial][t] += assignToNearestCentroid(*data, tile, tileEnd, centroidStores[trial], labels, nullptr, &threadSums[trial][t]);
+					});
+				}
+			}
+		}, "batched trials");
+
+		// update the centroids of every trial, the converged ones leave the batch
+		vector<size_t> stillActive;
+		for (size_t trial : active)
+		{
+			KmeansLabelResult& res = results[trial];
+			reduceClusterSums(threadSums[trial]);
+			res.sums = threadSums[trial][0];
+			res.sqDist = accumulate(threadSqDist[trial].begin(), threadSqDist[trial].end(), 0.0);
+			res.converged = updateCentroids(res.sums, centroidStores[trial], options.tolerance);
+			res.iterations = iter + 1;
+			res.distanceEvaluations += n * centroidStores[trial].size();
+			if (res.converged && options.race != nullptr)
+				options.race->finished(res);
+			if (!res.converged)
+				stillActive.push_back(trial);
+		}
+
+		// the trials are compared after the converged ones of this iteration were recorded
+		active.clear();
+		for (size_t trial : stillActive)
+		{
+			KmeansLabelResult& res = results[trial];
+			if (options.race != nullptr && options.race->hopeless(res.iterations, res.sqDist, previousSqDist[trial]))
+			{
+				res.abandoned = true;
+				options.race->finished(res);
+			}
+			else
+				active.push_back(trial);
+			previousSqDist[trial] = res.sqDist;
+		}
+	}
+
+	for (size_t trial = 0; trial < nTrials; trial++)
+	{
+		results[trial].centroids = centroidStores[trial].toPoints();
+		if (options.race != nullptr && !results[trial].converged && !results[trial].abandoned)
+			options.race->finished(results[trial]);
+	}
+	return results;
+}
+
+bool TrialRace::hopeless(size_t iterations, double sqDist, double previousSqDist) const
+{
+	double optimistic = sqDist - this->lookahead * max(0.0, previousSqDist - sqDist);
+	return iterations >= this->minIterations && optimistic > (1.0 + this->margin) * this->best.load();
+}
+
+void TrialRace::finished(const KmeansLabelResult& res)
+{
+	if (res.converged)
+	{
+		double current = this->best.load();
+		while (res.sqDist < current && !this->best.compare_exchange_weak(current, res.sqDist));
+	}
+
+	lock_guard<mutex> lock(this->statsMutex);
+	this->iterations += res.iterations;
+	if (res.converged)
+		this->convergedIterations.push_back(res.iterations);
+	else if (res.abandoned)
+		this->abandonedIterations.push_back(res.iterations);
+}
+
+void TrialRace::addCpuSeconds(double seconds)
+{
+	lock_guard<mutex> lock(this->statsMutex);
+	this->cpuSeconds += seconds;
+}
+
+size_t TrialRace::getPruned()
+{
+	lock_guard<mutex> lock(this->statsMutex);
+	return this->abandonedIterations.size();
 }
 
+double TrialRace::getSavedSeconds()
+{
+	lock_guard<mutex> lock(this->statsMutex);
+	if (this->convergedIterations.empty() || this->iterations == 0)
+		return 0.0;
+
+	double expectedIterations = accumulate(this->convergedIterations.begin(), this->convergedIterations.end(), 0.0) / this->convergedIterations.size();
+	double secondsPerIteration = this->cpuSeconds / this->iterations;
+	double saved = 0.0;
+	for (size_t done : this->abandonedIterations)
+		saved += max(0.0, expectedIterations - done) * secondsPerIteration;
+	return saved;
+}
 
+void parallelForRanges(size_t n, size_t numThreads, const function<void(size_t, size_t, size_t)>& f, const string& phase)
+{
+	auto range = [&](size_t t) {
+		size_t pointsPerThread = n / numThreads;
+		size_t start = t * pointsPerThread;
+		size_t end = (t == numThreads - 1) ? n : start + pointsPerThread;
+		f(t, start, end);
+	};
+
+	// with placed threads every range stays on its thread, so it is read from the node (and cache) of the thread
+	ThreadPool& pool = ThreadPool::global();
+	if (pool.isPlaced() && numThreads == pool.size())
+		pool.runOnEachThread(range, phase);
+	else
+		pool.run(numThreads, range, phase);
+}
+
+double computeInertia(const Dataset& data, const vector<PointKmeans>& centroids, size_t numThreads, const vector<double>* weights)
+{
+	numThreads = max<size_t>(1, numThreads);
+	checkWeights(weights, data.size());
+	LabelArray labels(data.size(), centroids.size());
+	PointStore centroidStore(centroids);
+	vector<double> threadSqDist(numThreads, 0.0);
+	parallelForRanges(data.size(), numThreads, [&](size_t t, size_t begin, size_t end) {
+		labels.visit([&](auto* l) {
+			threadSqDist[t] = assignToNearestCentroid(*data, begin, end, centroidStore, l);
+			if (weights == nullptr)
+				return;
+			double sum = 0.0;
+			for (size_t i = begin; i < end; i++)
+			{
+				double dx = data->xData()[i] - centroidStore.xData()[l[i]];
+				double dy = data->yData()[i] - centroidStore.yData()[l[i]];
+				sum += (*weights)[i] * (dx * dx + dy * dy);
+			}
+			threadSqDist[t] = sum;
+		});
+	}, "inertia");
+	return accumulate(threadSqDist.begin(), threadSqDist.end(), 0.0);
+}
+
+void reduceClusterSums(vector<ClusterSums>& parts)
+{
+	// per-thread sums of a pool placed on several NUMA nodes: the first thread of every node adds the sums of the
+	// other threads of its node, then only the totals of the nodes cross the interconnect
+	ThreadPool& pool = ThreadPool::global();
+	if (pool.numNodes() > 1 && parts.size() == pool.size())
+	{
+		vector<size_t> firstOfNode(pool.numNodes(), parts.size());
+		for (size_t t = parts.size(); t-- > 0;)
+			firstOfNode[pool.nodeOf(t)] = t;
+		pool.runOnEachThread([&](size_t t) {
+			if (firstOfNode[pool.nodeOf(t)] != t)
+				return;
+			for (size_t u = t + 1; u < parts.size(); u++)
+				if (pool.nodeOf(u) == pool.nodeOf(t))
+					parts[t].add(parts[u]);
+		}, "reduction");
+		for (size_t node = 0; node < firstOfNode.size(); node++)
+			if (firstOfNode[node] != 0 && firstOfNode[node] < parts.size())
+				parts[0].add(parts[firstOfNode[node]]);
+		return;
+	}
+
+	// in every round part t adds part t + stride, the rounds halve the number of parts
+	// for small k waking the pool costs more than the additions, so the same tree is reduced on this thread
+	bool parallel = !parts.empty() && parts[0].size() >= 4'096;
+	for (size_t stride = 1; stride < parts.size(); stride *= 2)
+	{
+		size_t pairs = (parts.size() - stride + 2 * stride - 1) / (2 * stride);
+		auto addPair = [&parts, stride](size_t p) {
+			size_t t = 2 * stride * p;
+			parts[t].add(parts[t + stride]);
+		};
+		if (parallel)
+			ThreadPool::global().run(pairs, addPair, "reduction");
+		else
+			for (size_t p = 0; p < pairs; p++)
+				addPair(p);
+	}
+}
 
 int getRandomIndex(size_t n)
 {
 	static mt19937 mt{random_device{}()};
-	static uniform_int_distribution<> dist(0, n);
+	uniform_int_distribution<> dist(0, n);
 	return dist(mt);
 }
 
 void KmeansPlusPlus::initializeCentroids()  {
-	if (this->points.empty()) return;
+	if (this->store.empty()) return;
+
+	size_t n = this->store.size();
+	const double* x = this->store->xData();
+	const double* y = this->store->yData();
+	size_t numThreads = max<size_t>(1, min<size_t>(getNumThreads(), n / 10'000));
+
+	const double* w = this->weights ? this->weights->data() : nullptr;
 
 	this->centroids = vector<PointKmeans>(this->k);
 
-	// select first centroid from the points
-	this->centroids[0] = this->points[getRandomIndex(this->points.size() - 1)];
+	// select first centroid from the points (with probability proportional to the weight of the point)
+	this->centroids[0] = this->store->at((w != nullptr) ? this->randomPointIndices(1)[0] : getRandomIndex(n - 1));
+
+	// distance of every point to its closest centroid so far
+	// and prefix sums of these distances inside the range of each thread
+	vector<double> distances(n, numeric_limits<double>::max());
+	vector<double> prefix(n);
+	vector<double> rangeTotals(numThreads);
+	vector<size_t> rangeBegins(numThreads);
+	static mt19937 mt{random_device{}()};
 
 	for (size_t i = 1; i < this->k; ++i) {
-		vector<double> distances(this->points.size(), numeric_limits<double>::max());
-
-		// count weights of the points (distance to the closest centroid)
-		for (size_t j = 0; j < this->points.size(); ++j) {
-			for (size_t m = 0; m < i; ++m) {
-				PointKmeans point = this->points[j];
-				PointKmeans centroid = this->centroids[m];
-				double dist = squaredEuclidianDist(point, centroid);
-				distances[j] = min(distances[j], dist);
+		double cx = this->centroids[i - 1].getX();
+		double cy = this->centroids[i - 1].getY();
+
+		// only the newest centroid can make the distances smaller
+		parallelForRanges(n, numThreads, [&](size_t t, size_t begin, size_t end) {
+			double cumulative = 0.0;
+			for (size_t j = begin; j < end; ++j) {
+				double dx = x[j] - cx;
+				double dy = y[j] - cy;
+				distances[j] = min(distances[j], dx * dx + dy * dy);
+				cumulative += (w != nullptr) ? w[j] * distances[j] : distances[j];
+				prefix[j] = cumulative;
 			}
+			rangeBegins[t] = begin;
+			rangeTotals[t] = cumulative;
+		}, "seeding");
+
+		// select a point from the weighted probability distribution
+		double totalDistance = accumulate(rangeTotals.begin(), rangeTotals.end(), 0.0);
+		if (totalDistance <= 0.0) {
+			// all points are at a centroid already
+			this->centroids[i] = this->store->at(getRandomIndex(n - 1));
+			continue;
 		}
-
-		// select a point from the wighted probability distribution
-		double totalDistance = accumulate(distances.begin(), distances.end(), 0.0);
 		uniform_real_distribution<> distribution(0, totalDistance);
-		double randomValue = distribution(mt19937(random_device{}()));
+		double randomValue = distribution(mt);
 
-		double cumulative = 0.0;
-		for (size_t j = 0; j < distances.size(); ++j) {
-			cumulative += distances[j];
-			if (cumulative >= randomValue) {
-				this->centroids[i] = this->points[j];
-				break;
+		// find the range of the thread, then binary search inside its prefix sums
+		size_t t = 0;
+		while (t + 1 < numThreads && randomValue >= rangeTotals[t]) {
+			randomValue -= rangeTotals[t];
+			t++;
+		}
+		size_t begin = rangeBegins[t];
+		size_t end = (t + 1 < numThreads) ? rangeBegins[t + 1] : n;
+		size_t j = upper_bound(prefix.begin() + begin, prefix.begin() + end, randomValue) - prefix.begin();
+		this->centroids[i] = this->store->at(min(j, end - 1));
+	}
+}
+
+void ScalableKmeansPlusPlus::initializeCentroids()
+{
+	if (this->store.empty()) return;
+
+	size_t n = this->store.size();
+	size_t numThreads = max<size_t>(1, min<size_t>(getNumThreads(), n / 10'000));
+	const double* w = this->weights ? this->weights->data() : nullptr;
+	static mt19937 mt{random_device{}()};
+
+	// first candidate is chosen randomly
+	PointStore candidates;
+	size_t first = (w != nullptr) ? this->randomPointIndices(1)[0] : getRandomIndex(n - 1);
+	candidates.push_back(this->store->xData()[first], this->store->yData()[first]);
+
+	// closest candidate of every point and the squared distance to it
+	vector<uint32_t> closest(n, 0);
+	vector<double> distances(n, numeric_limits<double>::max());
+	vector<uint32_t> roundLabels(n);
+	vector<double> roundDistances(n);
+	vector<double> threadCost(numThreads);
+	vector<vector<uint32_t>> threadSamples(numThreads);
+	vector<uint32_t> threadSeeds(numThreads);
+
+	size_t newFrom = 0;
+	for (size_t round = 0; round <= this->rounds; round++)
+	{
+		// distances to the candidates of the last round, the older candidates are already in distances
+		PointStore newCandidates;
+		for (size_t c = newFrom; c < candidates.size(); c++)
+			newCandidates.push_back(candidates.xData()[c], candidates.yData()[c]);
+
+		parallelForRanges(n, numThreads, [&](size_t t, size_t begin, size_t end) {
+			assignToNearestCentroid(*this->store, begin, end, newCandidates, roundLabels.data(), roundDistances.data());
+			double cost = 0.0;
+			for (size_t i = begin; i < end; i++)
+			{
+				if (roundDistances[i] < distances[i])
+				{
+					distances[i] = roundDistances[i];
+					closest[i] = static_cast<uint32_t>(newFrom + roundLabels[i]);
+				}
+				cost += (w != nullptr) ? w[i] * distances[i] : distances[i];
 			}
+			threadCost[t] = cost;
+		}, "seeding");
+
+		if (round == this->rounds)
+			break;
+
+		double cost = accumulate(threadCost.begin(), threadCost.end(), 0.0);
+		if (cost <= 0.0)
+			break;
+
+		// sample every point independently with probability l * d^2 / cost (l * weight * d^2 / cost)
+		double l = this->oversampling * this->k;
+		for (size_t t = 0; t < numThreads; t++)
+			threadSeeds[t] = mt();
+		parallelForRanges(n, numThreads, [&](size_t t, size_t begin, size_t end) {
+			mt19937 threadMt(threadSeeds[t]);
+			uniform_real_distribution<> uniform(0.0, 1.0);
+			threadSamples[t].clear();
+			for (size_t i = begin; i < end; i++)
+			{
+				double d = (w != nullptr) ? w[i] * distances[i] : distances[i];
+				if (uniform(threadMt) < l * d / cost)
+					threadSamples[t].push_back(static_cast<uint32_t>(i));
+			}
+		}, "seeding");
+
+		newFrom = candidates.size();
+		for (size_t t = 0; t < numThreads; t++)
+		{
+			for (uint32_t i : threadSamples[t])
+				candidates.push_back(this->store->xData()[i], this->store->yData()[i]);
 		}
 	}
+
+	// weight of a candidate is the number (total weight) of points closest to it
+	size_t m = candidates.size();
+	vector<double> weights(m, 0.0);
+	for (size_t i = 0; i < n; i++)
+		weights[closest[i]] += (w != nullptr) ? w[i] : 1.0;
+
+	this->centroids = vector<PointKmeans>(this->k);
+	if (m <= this->k)
+	{
+		// not enough candidates, the rest is taken randomly from the points
+		for (size_t j = 0; j < this->k; j++)
+			this->centroids[j] = (j < m) ? candidates.at(j) : this->store->at(getRandomIndex(n - 1));
+		return;
+	}
+
+	// weighted Kmeans++ over the candidates
+	PointStore reduced;
+	vector<double> candidateDistances(m, numeric_limits<double>::max());
+	uniform_real_distribution<> firstDistribution(0.0, accumulate(weights.begin(), weights.end(), 0.0));
+	double firstValue = firstDistribution(mt);
+	size_t chosen = 0;
+	for (double cumulative = weights[0]; cumulative < firstValue && chosen + 1 < m; cumulative += weights[++chosen]);
+	reduced.push_back(candidates.xData()[chosen], candidates.yData()[chosen]);
+
+	for (size_t j = 1; j < this->k; j++)
+	{
+		double total = 0.0;
+		for (size_t c = 0; c < m; c++)
+		{
+			double dx = candidates.xData()[c] - reduced.xData()[j - 1];
+			double dy = candidates.yData()[c] - reduced.yData()[j - 1];
+			candidateDistances[c] = min(candidateDistances[c], dx * dx + dy * dy);
+			total += weights[c] * candidateDistances[c];
+		}
+		uniform_real_distribution<> distribution(0.0, total);
+		double randomValue = distribution(mt);
+		// candidates without weight or already chosen are skipped, rounding can leave randomValue above the sum,
+		// then the last candidate with a share is taken
+		chosen = m;
+		size_t lastPositive = m;
+		double cumulative = 0.0;
+		for (size_t c = 0; c < m && chosen == m; c++)
+		{
+			double share = weights[c] * candidateDistances[c];
+			if (share <= 0.0)
+				continue;
+			lastPositive = c;
+			cumulative += share;
+			if (cumulative >= randomValue)
+				chosen = c;
+		}
+		if (chosen == m)
+			chosen = lastPositive;
+
+		// no weighted candidate is left, take any oversampled candidate that is not chosen yet
+		for (size_t c = 0; chosen == m && c < m; c++)
+		{
+			if (candidateDistances[c] > 0.0)
+				chosen = c;
+		}
+
+		if (chosen < m)
+		{
+			reduced.push_back(candidates.xData()[chosen], candidates.yData()[chosen]);
+		}
+		else
+		{
+			// all candidates are centroids already (the points have fewer distinct positions than k)
+			PointKmeans point = this->store->at(getRandomIndex(n - 1));
+			reduced.push_back(point.getX(), point.getY());
+		}
+	}
+
+	// a few weighted Lloyd iterations over the candidates
+	vector<uint32_t> candidateLabels(m);
+	vector<double> sumX(this->k), sumY(this->k), weightSums(this->k);
+	for (size_t iter = 0; iter < 20; iter++)
+	{
+		assignToNearestCentroid(candidates, 0, m, reduced, candidateLabels.data());
+		fill(sumX.begin(), sumX.end(), 0.0);
+		fill(sumY.begin(), sumY.end(), 0.0);
+		fill(weightSums.begin(), weightSums.end(), 0.0);
+		for (size_t c = 0; c < m; c++)
+		{
+			sumX[candidateLabels[c]] += weights[c] * candidates.xData()[c];
+			sumY[candidateLabels[c]] += weights[c] * candidates.yData()[c];
+			weightSums[candidateLabels[c]] += weights[c];
+		}
+
+		bool converged = true;
+		for (size_t j = 0; j < this->k; j++)
+		{
+			if (weightSums[j] <= 0.0)
+				continue;
+			double meanX = sumX[j] / weightSums[j];
+			double meanY = sumY[j] / weightSums[j];
+			if (abs(meanX - reduced.xData()[j]) + abs(meanY - reduced.yData()[j]) > 0.0001)
+				converged = false;
+			reduced.xData()[j] = meanX;
+			reduced.yData()[j] = meanY;
+		}
+		if (converged)
+			break;
+	}
+
+	this->centroids = reduced.toPoints();
 }
@@ -11,6 +11,12 @@
 #include <numeric>
 #include <atomic>
 #include <cstdlib>
+#include <functional>
+#include <chrono>
+#include <stdexcept>
+
+#include "pointStore.hpp"
+#include "threadPool.hpp"
 
 using namespace std;
 
@@ -26,11 +32,11 @@ public:
 
 	PointKmeans(double x, double y);
 
-	double getX() { return this->x; };
+	double getX() const { return this->x; };
 
 	void setX(double x) { this->x = x; };
 
-	double getY() { return this->y; };
+	double getY() const { return this->y; };
 
 	void setY(double y) { this->y = y; };
 
@@ -43,21 +49,125 @@ private:
 	double y;
 };
 
+// Output of the label result mode of Kmeans
+// Instead of copies of the points grouped by cluster it holds one label per point
+struct KmeansLabelResult {
+	vector<PointKmeans> centroids;
+	LabelArray labels;
+	ClusterSums sums;		// sums and counts of the final assignment
+	double sqDist = 0.0;	// sum of squared distances of the points to their centroids
+	size_t iterations = 0;
+	size_t distanceEvaluations = 0;	// number of point-centroid distances computed
+	bool converged = false;
+	bool abandoned = false;	// stopped by a TrialRace before it converged
+};
+
+// Early abandonment of the trials of multiple trials kmeans
+// sqDist of a trial never increases between the iterations, but it has no useful lower bound, so the race is a heuristic:
+// a trial is abandoned once, after minIterations, even its optimistic projection - the sqDist minus lookahead times
+// the decrease in the last iteration - is more than (1 + margin) times the sqDist of the best converged trial
+// Larger margin or lookahead lowers the risk of abandoning the trial that would win
+// Shared by the concurrent fits of one multiple trials run
+class TrialRace {
+
+public:
+
+	TrialRace(double margin = 0.05, size_t minIterations = 3, double lookahead = 5.0)
+	: margin(margin), minIterations(minIterations), lookahead(lookahead) {};
+
+	// True if a trial with sqDist after the given number of iterations (previousSqDist after one less) cannot win
+	bool hopeless(size_t iterations, double sqDist, double previousSqDist) const;
+
+	// Records the outcome of a trial, a converged trial may become the new best one
+	void finished(const KmeansLabelResult& res);
+
+	// Adds the CPU time spent by the trials
+	void addCpuSeconds(double seconds);
+
+	size_t getPruned();
+
+	// Estimated CPU time the abandoned trials would have needed to converge
+	// (average number of iterations of the converged trials at the average cost of an iteration)
+	double getSavedSeconds();
+
+private:
+	double margin;
+	size_t minIterations;
+	double lookahead;
+	atomic<double> best{numeric_limits<double>::max()};
+
+	mutex statsMutex;
+	vector<size_t> convergedIterations;
+	vector<size_t> abandonedIterations;
+	size_t iterations = 0;
+	double cpuSeconds = 0.0;
+};
+
+// Settings of fit
+struct FitOptions {
+	size_t maxIter = 1'000;
+	size_t numThreads = 1;		// the assignment is split into this many ranges run on the global pool
+	double tolerance = 0.0001;	// converged when no centroid moves by more (L1 distance)
+	TrialRace* race = nullptr;	// if not null, the fit is abandoned once the race finds it hopeless
+	const vector<double>* weights = nullptr;	// per-point weights (weighted kmeans), all points weigh 1 if null, one per point
+};
+
+// Lloyd's kmeans of the dataset from the given initial centroids (k = initCentroids.size()) in the label result mode
+// Reads only its arguments and returns everything in the result, so any number of fits can run
+// concurrently over one shared dataset
+// With weights the centroids are the weighted means and sqDist is the weighted sum of the squared distances
+// Throws invalid_argument if the weights are not one per point
+KmeansLabelResult fit(const Dataset& data, const vector<PointKmeans>& initCentroids, const FitOptions& options = FitOptions());
+
+// Runs one fit for every set of initial centroids (trial) in a single pass over the data per iteration
+// The points are processed in tiles that stay in the cache while they are assigned for all active trials,
+// so the data is read once per iteration instead of once per trial. Converged trials drop out of the batch
+// Each result is the same as the one of fit with the same options
+vector<KmeansLabelResult> fitTrials(const Dataset& data, const vector<vector<PointKmeans>>& initCentroids, const FitOptions& options = FitOptions());
+
+// Splits n points into numThreads contiguous ranges the same way as ParallelKmeans
+// and calls f(range index, begin, end) for every range on the threads of the global pool
+// If the pool is placed (NUMA mode) and numThreads is its size, range t always runs on thread t
+// phase names the job in the utilization statistics of the pool
+void parallelForRanges(size_t n, size_t numThreads, const function<void(size_t, size_t, size_t)>& f, const string& phase = "other");
+
+// Sum of the squared distances of the points to their nearest centroids, split into numThreads ranges
+// With weights every squared distance is multiplied by the weight of its point (throws if they are not one per point)
+double computeInertia(const Dataset& data, const vector<PointKmeans>& centroids, size_t numThreads = 1, const vector<double>* weights = nullptr);
+
+// Adds parts[1..] into parts[0] by a pairwise tree reduction on the global pool
+// Per-thread parts of a pool placed on several NUMA nodes are reduced on every node first
+void reduceClusterSums(vector<ClusterSums>& parts);
+
 // Generate random index in the 
 int getRandomIndex(size_t n);
 
 class Kmeans {
 
 protected:
-    vector<PointKmeans> points;
+    Dataset store; // SoA points used by the assignment kernel, shared with the copies of the model
     size_t k;
     size_t maxIter;
     vector<PointKmeans> centroids;
+    shared_ptr<const vector<double>> weights; // per-point weights shared with the copies of the model, null if all points weigh 1
     double sqDist = 0.0; // variable for multiple trials version for selecting the best trial
 
+    // Returns the converged trial with the smallest sqDist and its clusters
+    pair<vector<PointKmeans>, vector<vector<PointKmeans>>> bestTrial(const vector<KmeansLabelResult>& results);
+
+    // Weights for FitOptions, null if the points are not weighted
+    const vector<double>* weightsOrNull() const { return this->weights ? this->weights.get() : nullptr; };
+
+    // Indices of count distinct random points, a weighted point is drawn with probability proportional to its weight
+    vector<size_t> randomPointIndices(size_t count);
+
+    // Throws invalid_argument if the points are weighted, called by the versions that cannot use the weights
+    void requireUnweighted(const string& name) const;
+
 public:
 
-	Kmeans(vector<PointKmeans> points, size_t k, size_t maxIter=1'000);
+	// Takes the points as a shared dataset, a vector<PointKmeans> is converted to a new one
+	Kmeans(Dataset data, size_t k, size_t maxIter=1'000);
 
 	virtual void initializeCentroids();
 
@@ -65,23 +175,49 @@ public:
 	vector<vector<PointKmeans>> initializeCentroidsForMultipleTrials(size_t nTrials);
 
 	// Basic kmeans
+	// With weights it runs in the label result mode, so the clusters are built from the labels after the run
 	virtual pair<vector<PointKmeans>, vector<vector<PointKmeans>>> k_means();
 
 	// Runs multiple trials of Basic Kmeans
+	// Every trial is an independent fit, the best one (smallest sqDist) is returned
     pair<vector<PointKmeans>, vector<vector<PointKmeans>>> k_meansMultipleTrials(size_t nTrials, vector<vector<PointKmeans>> initCentroids);
 
-	// Helper function for parallel kmeans
-	// Same as Basic kmeans, but returns the sqDist as well
-    tuple<double, vector<PointKmeans>, vector<vector<PointKmeans>>> k_meansForParallel(vector<PointKmeans> c);
+	// Basic kmeans in the label result mode
+	// Sums and counts are accumulated during the assignment, so an iteration does not allocate or copy the points
+	virtual KmeansLabelResult k_meansLabels();
+
+	// Groups copies of the points by their labels (e.g. for plotting the output of the label mode)
+	vector<vector<PointKmeans>> clustersFromLabels(const LabelArray& labels);
 
 	// Runs in parallel multiple trials of Basic Kmeans
-    pair<vector<PointKmeans>, vector<vector<PointKmeans>>> k_meansParallelMultipleTrials(size_t nTrials, vector<vector<PointKmeans>> initCentroids);
+	// The trials are fits over the shared dataset on the threads of the pool, so they do not modify the model
+	// With a race the trials that cannot win are abandoned early
+    pair<vector<PointKmeans>, vector<vector<PointKmeans>>> k_meansParallelMultipleTrials(size_t nTrials, vector<vector<PointKmeans>> initCentroids, TrialRace* race = nullptr);
 
-	vector<PointKmeans> getPoints() { return this->points; };
+	// Runs multiple trials of Basic Kmeans as one batch (see fitTrials), numThreads splits the points of every pass
+    pair<vector<PointKmeans>, vector<vector<PointKmeans>>> k_meansBatchedMultipleTrials(size_t nTrials, vector<vector<PointKmeans>> initCentroids, size_t numThreads = 1, TrialRace* race = nullptr);
+
+	vector<PointKmeans> getPoints() { return this->store->toPoints(); };
+
+	const Dataset& getDataset() { return this->store; };
 
     vector<PointKmeans> getCentroids() { return this->centroids; };
 
+    // Sum of squared distances of the points to their centroids in the last run
+    double getSqDist() { return this->sqDist; };
+
     void setCentroids(vector<PointKmeans>& centroids) { this->centroids = centroids; };
+
+    // Weight of every point (e.g. the count of an aggregated point or a coreset weight), the centroids become
+    // the weighted means of their clusters and sqDist the weighted inertia
+    // Used by Kmeans, ParallelKmeans, the seedings and the multiple trials, the accelerated and mini-batch versions
+    // throw invalid_argument when they run on weighted points
+    void setWeights(vector<double> weights) { this->setWeights(make_shared<const vector<double>>(move(weights))); };
+
+    // Throws invalid_argument if there is not one weight per point
+    void setWeights(shared_ptr<const vector<double>> weights);
+
+    shared_ptr<const vector<double>> getWeights() { return this->weights; };
 };
 
 class ParallelKmeans : public Kmeans{
@@ -89,25 +225,45 @@ class ParallelKmeans : public Kmeans{
 public:
 
 	// Parallel version also takes the centroids as argument to ensure it is computing everything the same way as single Threaded version
-	ParallelKmeans(vector<PointKmeans> points, size_t k, vector<PointKmeans> centroids, size_t maxIter = 1'000);
+	ParallelKmeans(Dataset data, size_t k, vector<PointKmeans> centroids, size_t maxIter = 1'000);
 
 	pair<vector<PointKmeans>, vector<vector<PointKmeans>>> k_means() override;
 
+	KmeansLabelResult k_meansLabels() override;
+
 };
 
 class KmeansPlusPlus : public Kmeans {
 
 public:
 
-	KmeansPlusPlus(vector<PointKmeans> points, size_t k, size_t maxIter = 1'000)
-    : Kmeans(points, k, maxIter) {};
+	KmeansPlusPlus(Dataset data, size_t k, size_t maxIter = 1'000)
+    : Kmeans(data, k, maxIter) {};
 
 	// Kmeans++ centroids inicialization
 	// Uses points selection that are selected randomly from a weighted probability distribution
 	// Weight of each point is its squared distance to the nearest already generated centroid
+	// (multiplied by the weight of the point if the points are weighted)
     void initializeCentroids() override;
 
 };
 
+class ScalableKmeansPlusPlus : public Kmeans {
+
+public:
+
+	// rounds: number of oversampling rounds
+	// oversampling: expected number of candidates sampled in a round, as a multiple of k
+	ScalableKmeansPlusPlus(Dataset data, size_t k, size_t maxIter = 1'000, size_t rounds = 5, double oversampling = 2.0)
+	: Kmeans(data, k, maxIter), rounds(rounds), oversampling(oversampling) {};
 
+	// Kmeans|| centroids initialization (Bahmani et al., 2012)
+	// Every round samples each point independently with probability oversampling * k * d^2 / cost, in parallel over the points
+	// The candidates are weighted by the number of points closest to them and reduced to k centroids by weighted Kmeans++
+	// followed by a few weighted Lloyd iterations. Unlike Kmeans++ it needs only a few passes over the data
+	void initializeCentroids() override;
 
+private:
+	size_t rounds;
+	double oversampling;
+};
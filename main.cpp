@@ -7,6 +7,8 @@
 #include "kmeans.hpp"
 #include "dataGenerator.hpp"
 #include "tests.hpp"
+#include "cpuTopology.hpp"
+#include "pointFile.hpp"
 #include <chrono>
 
 using namespace std;
@@ -16,9 +18,14 @@ void printHelp(){
     cout << "Options:" << endl;
     cout << "\t\t--help\t\t\tShow this help message" << endl;
     cout << "\tInput options (you can use only one of these arguments at a time):" << endl;
-    cout << "\t\t--file\t\t\tDefault input option. Read points from a file" << endl;
+    cout << "\t\t--file\t\t\tDefault input option. Read points from a file (text or binary, detected from the content)" << endl;
     cout << "\t\t--random\t\tGenerate random points" << endl;
     cout << "\t\t--allFiles\t\tRun the algorithm for all test files" << endl;
+    cout << "\t\t--noCache\t\tParse text input files every time instead of mapping their binary cache (<file>.kmcache)" << endl;
+    cout << "\t\t--convert <in> <out>\tConvert a text point file (\"x y [weight]\" lines) to the binary point format and exit" << endl;
+    cout << "\t\t--online\t\tCluster points (\"x y\" lines) arriving on stdin online, requires --clusters" << endl;
+    cout << "\t\t--onlineInput <path>\tRead the points of the online mode from a named pipe or a file instead of stdin" << endl;
+    cout << "\t\t--snapshotPoints <n>\tPoints between two centroid snapshots of the online mode (default 100000, 0 - only at the end)" << endl;
     cout << "\tOutput options:" << endl;
     cout << "\t\t--plot\t\t\tSave plot of the output" << endl;
     cout << "\t\t--save\t\t\tSave the input points to a file" << endl;
@@ -29,8 +36,27 @@ void printHelp(){
     cout << "\t\t--basic\t\tDefault option. Run the basic version of the algorithm" << endl;
     cout << "\t\t        \t\tMust be explicitly set if you want to run the basic version and other versions at the same time" << endl;
     cout << "\t\t--plusplus\t\tRun the kmeans++ version of the algorithm" << endl;
+    cout << "\t\t--scalable\t\tRun kmeans initialized by kmeans|| (parallel oversampling seeding)" << endl;
     cout << "\t\t--multiTrials\t\tRun the multiple trials version of the algorithm" << endl;
+    cout << "\t\t--racing\t\tAbandon the trials of the multiple trials version that cannot win" << endl;
+    cout << "\t\t--racingMargin <m>\tAbandon a trial once its projected sum of squared distances is more than (1 + m) times the best one (default 0.05)" << endl;
+    cout << "\t\t--miniBatch\t\tRun the mini-batch version of the algorithm" << endl;
+    cout << "\t\t--batchSize <n>\t\tNumber of points in a batch of the mini-batch version (default 1024)" << endl;
+    cout << "\t\t--countDecay <d>\tDecay of the per-centroid counts of the mini-batch version before each batch (default 1 = learning rate 1/count)" << endl;
     cout << "\t\t--allVersions\t\tRun all versions of the algorithm (basic, ++, MT)" << endl;
+    cout << "\t\t--labels\t\tReturn per-point labels instead of copying the points into clusters (basic and ++ versions)" << endl;
+    cout << "\t\t--elkan\t\t\tRun Elkan kmeans (triangle inequality) from the initial centroids of the basic version" << endl;
+    cout << "\t\t--hamerly\t\tRun Hamerly kmeans (one upper and one lower bound per point), respects --singleThread and --parallel" << endl;
+    cout << "\t\t--yinyang\t\tRun Yinyang kmeans (grouped centroids, for large k), respects --singleThread and --parallel" << endl;
+    cout << "\t\t--kdtree\t\tRun kd-tree filtering kmeans (2D only), respects --singleThread and --parallel" << endl;
+    cout << "\t\t--threads <n>\t\tNumber of threads of the parallel versions (default: CPUs allowed by the affinity mask and the cgroup quota)" << endl;
+    cout << "\t\t--affinity <policy>\tPin the threads: compact, scatter or a CPU list such as 0-3,8" << endl;
+    cout << "\t\t--numa\t\t\tPin the threads to the NUMA nodes and place the points on the node of the thread that processes them" << endl;
+    cout << "\t\t--streaming\t\tRun streaming kmeans, every iteration reads the input file again in chunks" << endl;
+    cout << "\t\t--chunkPoints <n>\tPoints of a chunk buffer of streaming kmeans (default 65536)" << endl;
+    cout << "\t\t--spillLabels <file>\tWrite the labels of streaming kmeans to a file (uint32 per point)" << endl;
+    cout << "\t\t--coreset <m>\t\tRun weighted kmeans and the multiple trials over a coreset of about m points and report their inertia on all the points" << endl;
+    cout << "\t\t--clusters <k>\t\tOverride the number of clusters given by the name of the input file" << endl;
 
 }
 
@@ -44,8 +70,31 @@ enum class ARGUMENTS {
     SINGLETHREAD,
     BASIC,
     PLUSPLUS,
+    SCALABLE,
     MULTITRIALS,
+    RACING,
+    RACINGMARGIN,
+    MINIBATCH,
+    BATCHSIZE,
+    COUNTDECAY,
     ALLVERSIONS,
+    LABELS,
+    ELKAN,
+    HAMERLY,
+    YINYANG,
+    KDTREE,
+    CLUSTERS,
+    THREADS,
+    NUMA,
+    AFFINITY,
+    NOCACHE,
+    STREAMING,
+    CHUNKPOINTS,
+    SPILLLABELS,
+    ONLINE,
+    CORESET,
+    ONLINEINPUT,
+    SNAPSHOTPOINTS,
     INVALID
 };
 
@@ -59,8 +108,31 @@ ARGUMENTS getArgument(const string& arg){
     if(arg == "--parallel") return ARGUMENTS::PARALLEL;
     if(arg == "--basic") return ARGUMENTS::BASIC;
     if(arg == "--plusplus") return ARGUMENTS::PLUSPLUS;
+    if(arg == "--scalable") return ARGUMENTS::SCALABLE;
     if(arg == "--multiTrials") return ARGUMENTS::MULTITRIALS;
+    if(arg == "--racing") return ARGUMENTS::RACING;
+    if(arg == "--racingMargin") return ARGUMENTS::RACINGMARGIN;
+    if(arg == "--miniBatch") return ARGUMENTS::MINIBATCH;
+    if(arg == "--batchSize") return ARGUMENTS::BATCHSIZE;
+    if(arg == "--countDecay") return ARGUMENTS::COUNTDECAY;
     if(arg == "--allVersions") return ARGUMENTS::ALLVERSIONS;
+    if(arg == "--labels") return ARGUMENTS::LABELS;
+    if(arg == "--elkan") return ARGUMENTS::ELKAN;
+    if(arg == "--hamerly") return ARGUMENTS::HAMERLY;
+    if(arg == "--yinyang") return ARGUMENTS::YINYANG;
+    if(arg == "--kdtree") return ARGUMENTS::KDTREE;
+    if(arg == "--clusters") return ARGUMENTS::CLUSTERS;
+    if(arg == "--threads") return ARGUMENTS::THREADS;
+    if(arg == "--numa") return ARGUMENTS::NUMA;
+    if(arg == "--affinity") return ARGUMENTS::AFFINITY;
+    if(arg == "--noCache") return ARGUMENTS::NOCACHE;
+    if(arg == "--streaming") return ARGUMENTS::STREAMING;
+    if(arg == "--chunkPoints") return ARGUMENTS::CHUNKPOINTS;
+    if(arg == "--spillLabels") return ARGUMENTS::SPILLLABELS;
+    if(arg == "--online") return ARGUMENTS::ONLINE;
+    if(arg == "--coreset") return ARGUMENTS::CORESET;
+    if(arg == "--onlineInput") return ARGUMENTS::ONLINEINPUT;
+    if(arg == "--snapshotPoints") return ARGUMENTS::SNAPSHOTPOINTS;
     return ARGUMENTS::INVALID;
     
 }
@@ -73,16 +145,24 @@ int main(int argc, char* argv[]) {
         return 0;
     }
 
+    // text files are converted once, the binary file is then mapped instead of parsed
+    // a third number on a line is the weight of the point, it is stored in the weights block
+    if (argc == 4 && string(argv[1]) == "--convert") {
+        PointFile input = readWeightedTextPointFile(argv[2]);
+        if (input.points.empty() || !writeBinaryPointFile(argv[3], *input.points, input.weights)) {
+            cout << "Cannot convert " << argv[2] << " to " << argv[3] << endl;
+            return 1;
+        }
+        cout << "Converted " << input.points.size() << " points" << (input.weights.empty() ? "" : " with weights") << " to " << argv[3] << endl;
+        return 0;
+    }
+
     bool random = false;
     bool file = false;
-    bool plot = false;
     bool save = false;
-    bool singleThread = false;
-    bool parallel = false;
-    bool basic = false;
-    bool plusplus = false;
-    bool multi_trials = false;
     bool allFiles = false;
+    bool online = false;
+    TestOptions options;
 
     string filename = "";
     string savefile = "";
@@ -118,7 +198,7 @@ int main(int argc, char* argv[]) {
                 allFiles = true;
                 break;
             case ARGUMENTS::PLOT:
-                plot = true;
+                options.plot = true;
                 break;
             case ARGUMENTS::SAVE:
                 if(file){
@@ -128,25 +208,156 @@ int main(int argc, char* argv[]) {
                 save = true;
                 break;
             case ARGUMENTS::SINGLETHREAD:
-                singleThread = true;
+                options.singleThread = true;
                 break;
             case ARGUMENTS::PARALLEL:
-                parallel = true;
+                options.parallel = true;
                 break;
             case ARGUMENTS::BASIC:
-                basic = true;
+                options.basic = true;
                 break;
             case ARGUMENTS::PLUSPLUS:
-                plusplus = true;
+                options.plusplus = true;
+                break;
+            case ARGUMENTS::SCALABLE:
+                options.scalable = true;
                 break;
             case ARGUMENTS::MULTITRIALS:
-                multi_trials = true;
+                options.multiTrials = true;
+                break;
+            case ARGUMENTS::RACING:
+                options.racing = true;
+                break;
+            case ARGUMENTS::RACINGMARGIN:
+                if(i + 1 >= argc || atof(argv[i + 1]) < 0.0){
+                    cout << "--racingMargin requires a margin greater or equal to 0" << endl;
+                    return 1;
+                }
+                options.racingMargin = atof(argv[++i]);
+                break;
+            case ARGUMENTS::MINIBATCH:
+                options.miniBatch = true;
+                break;
+            case ARGUMENTS::BATCHSIZE:
+                if(i + 1 >= argc || atoi(argv[i + 1]) <= 0){
+                    cout << "--batchSize requires a batch size greater than 0" << endl;
+                    return 1;
+                }
+                options.batchSize = atoi(argv[++i]);
+                break;
+            case ARGUMENTS::COUNTDECAY:
+                if(i + 1 >= argc || atof(argv[i + 1]) <= 0.0 || atof(argv[i + 1]) > 1.0){
+                    cout << "--countDecay requires a decay in (0, 1]" << endl;
+                    return 1;
+                }
+                options.countDecay = atof(argv[++i]);
                 break;
             case ARGUMENTS::ALLVERSIONS:
-                basic = true;
-                plusplus = true;
-                multi_trials = true;
+                options.basic = true;
+                options.plusplus = true;
+                options.multiTrials = true;
+                break;
+            case ARGUMENTS::LABELS:
+                options.labels = true;
+                break;
+            case ARGUMENTS::ELKAN:
+                options.elkan = true;
+                break;
+            case ARGUMENTS::HAMERLY:
+                options.hamerly = true;
+                break;
+            case ARGUMENTS::YINYANG:
+                options.yinyang = true;
+                break;
+            case ARGUMENTS::KDTREE:
+                options.kdtree = true;
+                break;
+            case ARGUMENTS::CLUSTERS:
+                if(i + 1 >= argc || atoi(argv[i + 1]) <= 0){
+                    cout << "--clusters requires a number of clusters greater than 0" << endl;
+                    return 1;
+                }
+                options.clusters = atoi(argv[++i]);
+                break;
+            case ARGUMENTS::THREADS:
+                if(i + 1 >= argc || atoi(argv[i + 1]) <= 0){
+                    cout << "--threads requires a number of threads greater than 0" << endl;
+                    return 1;
+                }
+                setNumThreads(atoi(argv[++i]));
+                break;
+            case ARGUMENTS::NUMA:
+                options.numa = true;
+                setNumaMode(true);
+                break;
+            case ARGUMENTS::NOCACHE:
+                options.parseCache = false;
                 break;
+            case ARGUMENTS::STREAMING:
+                options.streaming = true;
+                break;
+            case ARGUMENTS::CHUNKPOINTS:
+                if(i + 1 >= argc || atoi(argv[i + 1]) <= 0){
+                    cout << "--chunkPoints requires a number of points greater than 0" << endl;
+                    return 1;
+                }
+                options.chunkPoints = atoi(argv[++i]);
+                break;
+            case ARGUMENTS::SPILLLABELS:
+                if(i + 1 >= argc){
+                    cout << "--spillLabels requires a file name" << endl;
+                    return 1;
+                }
+                options.spillLabels = argv[++i];
+                break;
+            case ARGUMENTS::CORESET:
+                if(i + 1 >= argc || atoi(argv[i + 1]) <= 0){
+                    cout << "--coreset requires a number of points greater than 0" << endl;
+                    return 1;
+                }
+                options.coreset = atoi(argv[++i]);
+                break;
+            case ARGUMENTS::ONLINE:
+                online = true;
+                break;
+            case ARGUMENTS::ONLINEINPUT:
+                if(i + 1 >= argc){
+                    cout << "--onlineInput requires a path" << endl;
+                    return 1;
+                }
+                online = true;
+                options.onlineInput = argv[++i];
+                break;
+            case ARGUMENTS::SNAPSHOTPOINTS:
+                if(i + 1 >= argc || atoi(argv[i + 1]) < 0){
+                    cout << "--snapshotPoints requires a number of points" << endl;
+                    return 1;
+                }
+                options.snapshotPoints = atoi(argv[++i]);
+                break;
+            case ARGUMENTS::AFFINITY:
+            {
+                if(i + 1 >= argc){
+                    cout << "--affinity requires compact, scatter or a list of CPUs" << endl;
+                    return 1;
+                }
+                string policy = argv[++i];
+                if(policy == "compact") setAffinityPolicy(AffinityPolicy::Compact);
+                else if(policy == "scatter") setAffinityPolicy(AffinityPolicy::Scatter);
+                else {
+                    vector<int> cpus;
+                    try {
+                        cpus = parseCpuList(policy);
+                    } catch(const exception&) {
+                    }
+                    if(cpus.empty()){
+                        cout << "Invalid affinity policy: " << policy << endl;
+                        return 1;
+                    }
+                    setAffinityPolicy(AffinityPolicy::List, cpus);
+                }
+                break;
+            }
             default:
                 cout << "Invalid option: " << argv[i] << endl;
                 return 1;
@@ -154,14 +365,28 @@ int main(int argc, char* argv[]) {
 
     }
 
+    // the online mode reads its points as they arrive, there is nothing to load or to compare
+    if(online){
+        if(file || random || allFiles){
+            cout << "You can't use --online and --file, --random or --allFiles at the same time" << endl;
+            return 1;
+        }
+        if(options.clusters <= 0){
+            cout << "--online requires --clusters" << endl;
+            return 1;
+        }
+        run_online(options.clusters, options);
+        return 0;
+    }
+
     // set default version if not selected parallel or singleThread explicitly
-    if(!parallel && !singleThread){
-        singleThread = true;
+    if(!options.parallel && !options.singleThread){
+        options.singleThread = true;
     }
 
-    // set default version if not selected basic, plusplus or multi_trials explicitly
-    if(!basic && !plusplus && !multi_trials){
-        basic = true;
+    // set default version if not selected basic, plusplus, scalable, multi_trials or miniBatch explicitly
+    if(!options.basic && !options.plusplus && !options.scalable && !options.multiTrials && !options.miniBatch){
+        options.basic = true;
     }
 
     // set default option for input
@@ -178,10 +403,10 @@ int main(int argc, char* argv[]) {
             cout << "Invalid number of points. Number of points must be greater than 0" << endl;
             return 1;
         }
-        cout << "Enter the number of clusters: (max 10) ";
+        cout << "Enter the number of clusters: ";
         cin >> numberOfClusters;
-        if(numberOfClusters <= 0 || numberOfClusters > 10){
-            cout << "Invalid number of clusters. Number of clusters must be greater than 0 and smaller or equal to 10" << endl;
+        if(numberOfClusters <= 0 || numberOfClusters > numberOfPoints){
+            cout << "Invalid number of clusters. Number of clusters must be greater than 0 and smaller or equal to the number of points" << endl;
             return 1;
         }
     } else if (file){
@@ -229,7 +454,7 @@ int main(int argc, char* argv[]) {
     }
     
     correct = false;
-    if (plot && !allFiles && !file){
+    if (options.plot && !allFiles && !file){
         while(!correct){
             cout << "Enter the filename to plot the points (without .svg): ";
             cout << "The plot will be saved in the images folder" << endl;
@@ -241,20 +466,20 @@ int main(int argc, char* argv[]) {
             }
         }
         plotfile = plotfile + "-" + to_string(numberOfClusters) + "c.svg";
-    } else if(plot && allFiles){
+    } else if(options.plot && allFiles){
         cout << "Plots will be saved in the images folder" << endl;
     }
 
 
     // Run the selected input
     if (file){
-        run_test_file(filename, singleThread, parallel, basic, plusplus, multi_trials, plot);
+        run_test_file(filename, options);
     }
     if (random){
-        run_test_random(numberOfPoints, numberOfClusters, singleThread, parallel, basic, plusplus, multi_trials, plot, save, savefile, plotfile);
+        run_test_random(numberOfPoints, numberOfClusters, options, save, savefile, plotfile);
     } 
     if (allFiles){
-        run_tests_for_all_files(singleThread, parallel, basic, plusplus, multi_trials, plot);
+        run_tests_for_all_files(options);
     }
 
     return 0;
@@ -0,0 +1,145 @@
+#include "miniBatchKmeans.hpp"
+
+MiniBatchKmeans::MiniBatchKmeans(Dataset data, size_t k, size_t maxIter, MiniBatchOptions options)
+: Kmeans(data, k, maxIter)
+{
+	this->options = options;
+	this->options.batchSize = max<size_t>(1, this->options.batchSize);
+	this->options.numThreads = max<size_t>(1, this->options.numThreads);
+}
+
+MiniBatchKmeans::MiniBatchKmeans(Dataset data, size_t k, vector<PointKmeans> centroids, size_t maxIter, MiniBatchOptions options)
+: MiniBatchKmeans(data, k, maxIter, options)
+{
+	this->centroids = centroids;
+}
+
+pair<vector<PointKmeans>, vector<vector<PointKmeans>>> MiniBatchKmeans::k_means()
+{
+	KmeansLabelResult res = this->k_meansLabels();
+	return {res.centroids, this->clustersFromLabels(res.labels)};
+}
+
+KmeansLabelResult MiniBatchKmeans::k_meansLabels()
+{
+	this->requireUnweighted("Mini-batch");
+
+	if (this->store.empty())
+		return KmeansLabelResult();
+
+	// initialize Centroids from given points
+	if (this->centroids.empty())
+		this->initializeCentroids();
+
+	size_t n = this->store.size();
+	size_t k = this->k;
+	size_t batchSize = min(this->options.batchSize, n);
+	size_t numThreads = this->options.numThreads;
+	size_t maxBatches = max<size_t>(1, this->maxIter * n / batchSize);
+	double smoothing = this->options.inertiaSmoothing;
+	if (smoothing <= 0.0)
+		smoothing = min(1.0, 2.0 * batchSize / (n + 1));
+
+	KmeansLabelResult res;
+	PointStore centroidStore(this->centroids);
+	PointStore batch;
+	batch.resize(batchSize);
+	vector<uint32_t> batchLabels(batchSize);
+	vector<double> counts(k, 0.0);
+	vector<ClusterSums> threadSums(numThreads, ClusterSums(k));
+	vector<double> threadSqDist(numThreads, 0.0);
+	ClusterSums batchSums(k);
+
+	static mt19937 mt{random_device{}()};
+	uniform_int_distribution<size_t> randomIndex(0, n - 1);
+
+	double smoothedInertia = -1.0;
+	double bestInertia = numeric_limits<double>::max();
+	size_t noImprovement = 0;
+
+	for (this->batches = 0; this->batches < maxBatches; this->batches++)
+	{
+		// sample the batch with replacement
+		for (size_t b = 0; b < batchSize; b++)
+		{
+			size_t i = randomIndex(mt);
+			batch.xData()[b] = this->store->xData()[i];
+			batch.yData()[b] = this->store->yData()[i];
+		}
+
+		// assign the batch to the clusters, every thread adds its part of the batch to its own sums
+		if (numThreads == 1)
+		{
+			threadSums[0].reset();
+			threadSqDist[0] = assignToNearestCentroid(batch, 0, batchSize, centroidStore, batchLabels.data(), nullptr, &threadSums[0]);
+		}
+		else
+		{
+			parallelForRanges(batchSize, numThreads, [&](size_t t, size_t begin, size_t end) {
+				threadSums[t].reset();
+				threadSqDist[t] = assignToNearestCentroid(batch, begin, end, centroidStore, batchLabels.data(), nullptr, &threadSums[t]);
+			}, "mini-batch");
+		}
+
+		batchSums.reset();
+		double batchInertia = 0.0;
+		for (size_t t = 0; t < numThreads; t++)
+		{
+			batchSums.add(threadSums[t]);
+			batchInertia += threadSqDist[t];
+		}
+
+		// move each centroid towards the mean of its batch points with the learning rate 1 / count
+		for (size_t j = 0; j < k; j++)
+		{
+			counts[j] *= this->options.countDecay;
+			if (batchSums.count[j] == 0)
+				continue;
+			double newCount = counts[j] + batchSums.count[j];
+			centroidStore.xData()[j] = (centroidStore.xData()[j] * counts[j] + batchSums.sumX[j]) / newCount;
+			centroidStore.yData()[j] = (centroidStore.yData()[j] * counts[j] + batchSums.sumY[j]) / newCount;
+			counts[j] = newCount;
+		}
+
+		// convergence by the smoothed inertia per point of the batches
+		batchInertia /= batchSize;
+		if (smoothedInertia < 0.0)
+			smoothedInertia = batchInertia;
+		else
+			smoothedInertia = smoothedInertia * (1.0 - smoothing) + batchInertia * smoothing;
+
+		if (smoothedInertia < bestInertia)
+		{
+			bestInertia = smoothedInertia;
+			noImprovement = 0;
+		}
+		else if (++noImprovement >= this->options.maxNoImprovement)
+		{
+			res.converged = true;
+			this->batches++;
+			break;
+		}
+	}
+
+	if (!res.converged)
+		cout << "Mini-batch did not converge." << endl;
+
+	// final assignment of all points for the labels, sums and sqDist, split like an iteration of fit
+	res.labels = LabelArray(n, k);
+	parallelForRanges(n, numThreads, [&](size_t t, size_t begin, size_t end) {
+		threadSums[t].reset();
+		res.labels.visit([&](auto* labels) {
+			threadSqDist[t] = assignToNearestCentroid(*this->store, begin, end, centroidStore, labels, nullptr, &threadSums[t]);
+		});
+	}, "mini-batch final");
+	reduceClusterSums(threadSums);
+	res.sums = threadSums[0];
+	this->sqDist = accumulate(threadSqDist.begin(), threadSqDist.end(), 0.0);
+	res.iterations = this->batches;
+	res.distanceEvaluations = (this->batches * batchSize + n) * k;
+
+	this->centroids = centroidStore.toPoints();
+	res.centroids = this->centroids;
+	res.sqDist = this->sqDist;
+	return res;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <vector>
+
+#include "kmeans.hpp"
+
+using namespace std;
+
+// Settings of MiniBatchKmeans
+struct MiniBatchOptions {
+	size_t batchSize = 1024;
+	// Learning rate of a centroid is 1 / (number of points assigned to it so far)
+	// Before every batch the counts are multiplied by countDecay, so with countDecay < 1
+	// the learning rate stops decreasing and the centroids keep following the newest batches
+	double countDecay = 1.0;
+	// Weight of the newest batch in the smoothed inertia, 0 selects 2 * batchSize / n
+	double inertiaSmoothing = 0.0;
+	// Stops after this many batches without an improvement of the smoothed inertia
+	size_t maxNoImprovement = 10;
+	size_t numThreads = 1;
+};
+
+// Mini-batch kmeans (Sculley, 2010)
+// Every step assigns a random batch of points and moves each centroid towards the mean of its batch points
+// with a per-centroid learning rate. Convergence is decided by the exponentially smoothed inertia of the batches,
+// so an answer is reached in a few passes over the data instead of running Lloyd iterations to convergence
+// maxIter is the maximal number of passes over the data
+class MiniBatchKmeans : public Kmeans {
+
+public:
+
+	MiniBatchKmeans(Dataset data, size_t k, size_t maxIter = 1'000, MiniBatchOptions options = MiniBatchOptions());
+
+	// Mini-batch kmeans from the given initial centroids
+	MiniBatchKmeans(Dataset data, size_t k, vector<PointKmeans> centroids, size_t maxIter = 1'000, MiniBatchOptions options = MiniBatchOptions());
+
+	pair<vector<PointKmeans>, vector<vector<PointKmeans>>> k_means() override;
+
+	// Labels, sums and sqDist of the result are computed by one final pass over all points
+	KmeansLabelResult k_meansLabels() override;
+
+	size_t getBatches() { return this->batches; };
+
+private:
+	MiniBatchOptions options;
+	size_t batches = 0;
+};
@@ -0,0 +1,68 @@
+#include "numa.hpp"
+
+Dataset placeOnNumaNodes(const Dataset& data)
+{
+	size_t n = data.size();
+	PointStore store;
+	store.resize(n);	// only allocated, the pages are touched below
+	parallelForRanges(n, ThreadPool::global().size(), [&](size_t, size_t begin, size_t end) {
+		copy(data->xData() + begin, data->xData() + end, store.xData() + begin);
+		copy(data->yData() + begin, data->yData() + end, store.yData() + begin);
+	}, "numa placement");
+	return Dataset(move(store));
+}
+
+// Sums the coordinates of a shard
+static double readShard(const PointStore& points, size_t begin, size_t end)
+{
+	double sum = 0.0;
+	for (size_t i = begin; i < end; i++)
+		sum += points.xData()[i] + points.yData()[i];
+	return sum;
+}
+
+NumaBandwidth measureNumaBandwidth(const Dataset& data)
+{
+	ThreadPool& pool = ThreadPool::global();
+	size_t n = data.size();
+	size_t numThreads = pool.size();
+
+	NumaBandwidth bandwidth;
+	bandwidth.nodes = pool.numNodes();
+	if (n == 0)
+		return bandwidth;
+
+	// shard t was first touched by thread t, the remote pass reads the shard of the next thread on another node
+	vector<size_t> remoteShard(numThreads);
+	for (size_t t = 0; t < numThreads; t++)
+	{
+		remoteShard[t] = t;
+		for (size_t offset = 1; offset < numThreads && remoteShard[t] == t; offset++)
+			if (pool.nodeOf((t + offset) % numThreads) != pool.nodeOf(t))
+				remoteShard[t] = (t + offset) % numThreads;
+	}
+	vector<size_t> localShard(numThreads);
+	iota(localShard.begin(), localShard.end(), 0);
+
+	vector<double> sums(numThreads, 0.0);	// written, so the reads are not optimized away
+	auto measure = [&](const vector<size_t>& shards) {
+		auto start = chrono::steady_clock::now();
+		parallelForRanges(n, numThreads, [&](size_t t, size_t, size_t) {
+			size_t shard = shards[t];
+			size_t pointsPerThread = n / numThreads;
+			size_t begin = shard * pointsPerThread;
+			size_t end = (shard == numThreads - 1) ? n : begin + pointsPerThread;
+			sums[t] += readShard(*data, begin, end);
+		}, "numa bandwidth");
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		return (seconds > 0.0) ? 2.0 * sizeof(double) * n / seconds * 1e-9 : 0.0;
+	};
+
+	// a first pass brings the pages of all shards in, then the local and the remote pass are timed
+	measure(localShard);
+	bandwidth.localGBs = measure(localShard);
+	if (bandwidth.nodes > 1)
+		bandwidth.remoteGBs = measure(remoteShard);
+
+	return bandwidth;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "kmeans.hpp"
+
+using namespace std;
+
+// Read bandwidth of the threads of the global pool
+struct NumaBandwidth {
+	size_t nodes = 1;
+	double localGBs = 0.0;	// every thread reads its own shard
+	double remoteGBs = 0.0;	// every thread reads the shard of a thread on another node, 0 with one node
+};
+
+// Copies the dataset into a new store whose shards (the ranges of parallelForRanges for the size of the global pool)
+// are written - and so first touched - by the threads that own them, so in the NUMA mode (setNumaMode) every shard
+// lies on the node of the thread that processes it in ParallelKmeans
+// The placement holds while the size of the pool does not change
+Dataset placeOnNumaNodes(const Dataset& data);
+
+// Measures the read bandwidth of the shards of the dataset from the threads of the global pool
+NumaBandwidth measureNumaBandwidth(const Dataset& data);
@@ -0,0 +1,80 @@
+#include "onlineKmeans.hpp"
+
+OnlineKmeans::OnlineKmeans(size_t k, OnlineOptions options)
+{
+	this->k = max<size_t>(1, k);
+	this->options = options;
+	this->options.batchSize = max<size_t>(1, this->options.batchSize);
+	this->options.numThreads = max<size_t>(1, this->options.numThreads);
+	this->centroidStore.reserve(this->k);
+	this->counts.reserve(this->k);
+}
+
+void OnlineKmeans::addBatch(const PointStore& batch)
+{
+	size_t begin = 0;
+
+	// the first distinct points become the centroids
+	for (; begin < batch.size() && this->centroidStore.size() < this->k; begin++)
+	{
+		PointKmeans p = batch.at(begin);
+		bool seen = false;
+		for (size_t j = 0; j < this->centroidStore.size() && !seen; j++)
+			seen = this->centroidStore.at(j).equal(p);
+		if (seen)
+			continue;
+		this->centroidStore.push_back(p.getX(), p.getY());
+		this->counts.push_back(1.0);
+	}
+	this->pointsSeen += begin;
+	if (begin == batch.size())
+		return;
+
+	size_t k = this->centroidStore.size();
+	size_t n = batch.size() - begin;
+	size_t numThreads = this->options.numThreads;
+	if (this->threadSums.size() != numThreads || this->threadSums[0].size() != k)
+		this->threadSums.assign(numThreads, ClusterSums(k));
+	this->labels.resize(batch.size());
+
+	// every thread adds its part of the batch to its own sums
+	parallelForRanges(n, numThreads, [&](size_t t, size_t start, size_t end) {
+		this->threadSums[t].reset();
+		assignToNearestCentroid(batch, begin + start, begin + end, this->centroidStore, this->labels.data(), nullptr, &this->threadSums[t]);
+	}, "online");
+	reduceClusterSums(this->threadSums);
+	const ClusterSums& batchSums = this->threadSums[0];
+
+	// move each centroid towards the mean of its batch points with the learning rate batch count / count
+	double* cx = this->centroidStore.xData();
+	double* cy = this->centroidStore.yData();
+	for (size_t j = 0; j < k; j++)
+	{
+		this->counts[j] *= this->options.countDecay;
+		if (batchSums.count[j] == 0)
+			continue;
+		double newCount = this->counts[j] + batchSums.count[j];
+		cx[j] = (cx[j] * this->counts[j] + batchSums.sumX[j]) / newCount;
+		cy[j] = (cy[j] * this->counts[j] + batchSums.sumY[j]) / newCount;
+		this->counts[j] = newCount;
+	}
+
+	this->pointsSeen += n;
+	this->batches++;
+}
+
+void OnlineKmeans::run(PointStreamReader& reader, const function<void(const vector<PointKmeans>&, size_t)>& snapshot)
+{
+	PointStore batch;
+	size_t nextSnapshot = this->pointsSeen + this->options.snapshotPoints;
+	while (reader.next(batch))
+	{
+		this->addBatch(batch);
+		if (this->options.snapshotPoints > 0 && this->pointsSeen >= nextSnapshot)
+		{
+			snapshot(this->getCentroids(), this->pointsSeen);
+			nextSnapshot = this->pointsSeen + this->options.snapshotPoints;
+		}
+	}
+	snapshot(this->getCentroids(), this->pointsSeen);
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+#include <functional>
+
+#include "kmeans.hpp"
+#include "pointFile.hpp"
+
+using namespace std;
+
+// Settings of OnlineKmeans
+struct OnlineOptions {
+	size_t batchSize = 1024;		// maximal points of a batch, a batch is smaller when the input has no more data yet
+	// Before every batch the per-centroid counts are multiplied by countDecay
+	// 1 weights all points seen so far equally, with countDecay < 1 a point loses weight with every later batch,
+	// so the centroids follow a window of about batchSize / (1 - countDecay) newest points
+	double countDecay = 1.0;
+	size_t snapshotPoints = 100'000;	// points between two snapshots, 0 - only the final one
+	size_t numThreads = 1;
+};
+
+// Sequential (online) kmeans over an unbounded stream of points
+// Every batch is assigned to the nearest centroids and each centroid moves to the weighted mean of its count
+// and its batch points (the update of MiniBatchKmeans), so the memory does not grow with the stream
+// The first k distinct points become the initial centroids
+class OnlineKmeans {
+
+public:
+
+	OnlineKmeans(size_t k, OnlineOptions options = OnlineOptions());
+
+	// Updates the centroids by a batch of points
+	void addBatch(const PointStore& batch);
+
+	// Reads batches until the end of the stream, snapshot(centroids, points seen) is called every
+	// snapshotPoints points and after the last batch
+	void run(PointStreamReader& reader, const function<void(const vector<PointKmeans>&, size_t)>& snapshot);
+
+	// Centroids so far (fewer than k until k distinct points were seen)
+	vector<PointKmeans> getCentroids() { return this->centroidStore.toPoints(); };
+
+	size_t getPointsSeen() { return this->pointsSeen; };
+
+	size_t getBatches() { return this->batches; };
+
+private:
+	size_t k;
+	OnlineOptions options;
+	PointStore centroidStore;
+	vector<double> counts;
+	vector<ClusterSums> threadSums;
+	vector<uint32_t> labels;
+	size_t pointsSeen = 0;
+	size_t batches = 0;
+};
@@ -0,0 +1,732 @@
+#include "pointFile.hpp"
+#include "threadPool.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <limits>
+#include <chrono>
+#include <sys/stat.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define POINT_FILE_MMAP
+#endif
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+static const char pointFileMagic[8] = {'K', 'M', 'P', 'O', 'I', 'N', 'T', 'S'};
+static const uint32_t pointFileVersion = 1;
+
+// Size of a block of n values of the given size padded to 64 bytes
+static uint64_t paddedBlock(uint64_t n, uint64_t valueSize)
+{
+	return (n * valueSize + 63) / 64 * 64;
+}
+
+bool isBinaryPointFile(const string& filename)
+{
+	ifstream file(filename, ios::binary);
+	char magic[8];
+	return file.read(magic, sizeof(magic)) && memcmp(magic, pointFileMagic, sizeof(magic)) == 0;
+}
+
+// Bytes of a whole file and the object keeping them alive (the mapping or a buffer)
+struct FileBytes {
+	const char* data = nullptr;
+	uint64_t size = 0;
+	shared_ptr<const void> owner;
+};
+
+static bool mapFile(const string& filename, FileBytes& bytes)
+{
+#ifdef POINT_FILE_MMAP
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0)
+	{
+		close(fd);
+		return false;
+	}
+	size_t size = (size_t)info.st_size;
+	void* address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);	// the mapping stays valid
+	if (address == MAP_FAILED)
+		return false;
+	madvise(address, size, MADV_WILLNEED);
+	bytes.data = static_cast<const char*>(address);
+	bytes.size = size;
+	bytes.owner = shared_ptr<const void>(address, [size](const void* p) { munmap(const_cast<void*>(p), size); });
+	return true;
+#else
+	// no mmap - the file is read into a buffer the points are a view of
+	ifstream file(filename, ios::binary | ios::ate);
+	if (!file)
+		return false;
+	auto buffer = make_shared<vector<char>>((size_t)file.tellg());
+	file.seekg(0);
+	if (buffer->empty() || !file.read(buffer->data(), buffer->size()))
+		return false;
+	bytes.data = buffer->data();
+	bytes.size = buffer->size();
+	bytes.owner = buffer;
+	return true;
+#endif
+}
+
+// Parses a decimal number such as -12.5e3 starting at p, returns the position after it or nullptr if there is none
+// Numbers with at most 19 significant digits and a small exponent are computed exactly from the digits,
+// the rest is passed to strtod
+static const char* parseDouble(const char* p, const char* end, double& value)
+{
+	static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+									1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+	const char* start = p;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = (*p++ == '-');
+
+	uint64_t mantissa = 0;
+	int digits = 0;			// significant digits in the mantissa
+	int exponent = 0;
+	bool anyDigit = false;
+	bool exact = true;		// all digits fit into the mantissa
+	for (; p < end && *p >= '0' && *p <= '9'; p++)
+	{
+		anyDigit = true;
+		if (digits < 19)
+		{
+			mantissa = mantissa * 10 + (*p - '0');
+			digits += (mantissa > 0);
+		}
+		else
+		{
+			exponent++;
+			exact = false;
+		}
+	}
+	if (p < end && *p == '.')
+	{
+		for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+		{
+			anyDigit = true;
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += (mantissa > 0);
+				exponent--;
+			}
+			else
+				exact = false;
+		}
+	}
+	if (!anyDigit)
+		return nullptr;
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		const char* e = p + 1;
+		bool negativeExponent = false;
+		if (e < end && (*e == '-' || *e == '+'))
+			negativeExponent = (*e++ == '-');
+		if (e < end && *e >= '0' && *e <= '9')
+		{
+			int value = 0;
+			for (; e < end && *e >= '0' && *e <= '9'; e++)
+				value = min(value * 10 + (*e - '0'), 100'000);
+			exponent += negativeExponent ? -value : value;
+			p = e;
+		}
+	}
+
+	// both the mantissa and the power of ten are exact doubles, so the result is correctly rounded
+	if (exact && mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22)
+	{
+		double result = (double)mantissa;
+		result = (exponent < 0) ? result / powers[-exponent] : result * powers[exponent];
+		value = negative ? -result : result;
+		return p;
+	}
+
+	char buffer[128];
+	if (p - start >= (ptrdiff_t)sizeof(buffer))
+		return nullptr;
+	copy(start, p, buffer);
+	buffer[p - start] = '\0';
+	value = strtod(buffer, nullptr);
+	// out of range, the line is skipped like by the stream operator
+	if (value == numeric_limits<double>::infinity() || value == -numeric_limits<double>::infinity())
+		return nullptr;
+	return p;
+}
+
+// Parses the lines in [begin, end) into xs and ys, at most maxPoints of them
+// If ws is not null, an optional third number of a line is its weight (1 without it, lines with a negative one are skipped)
+// Returns the position after the last parsed line
+static const char* parseLines(const char* begin, const char* end, vector<double>& xs, vector<double>& ys,
+							size_t maxPoints = numeric_limits<size_t>::max(), vector<double>* ws = nullptr)
+{
+	auto isSpace = [](char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f'; };
+	const char* p = begin;
+	size_t points = 0;
+	while (p < end && points < maxPoints)
+	{
+		const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+		if (lineEnd == nullptr)
+			lineEnd = end;
+
+		double x, y;
+		while (p < lineEnd && isSpace(*p))
+			p++;
+		p = parseDouble(p, lineEnd, x);
+		if (p != nullptr)
+		{
+			while (p < lineEnd && isSpace(*p))
+				p++;
+			p = parseDouble(p, lineEnd, y);
+			double w = 1.0;
+			if (p != nullptr && ws != nullptr)
+			{
+				while (p < lineEnd && isSpace(*p))
+					p++;
+				const char* weightEnd = parseDouble(p, lineEnd, w);
+				if (weightEnd == nullptr)
+					w = 1.0;
+				else if (w < 0.0)
+					p = nullptr;
+			}
+			if (p != nullptr)
+			{
+				xs.push_back(x);
+				ys.push_back(y);
+				if (ws != nullptr)
+					ws->push_back(w);
+				points++;
+			}
+		}
+		p = min(lineEnd + 1, end);
+	}
+	return p;
+}
+
+// Parses the lines of a whole text file in parallel, with the weights of the lines if weights is not null
+static Dataset parseText(const FileBytes& bytes, vector<double>* weights = nullptr)
+{
+	const char* text = bytes.data;
+	size_t size = bytes.size;
+
+	// ranges of about 1 MB, several per thread so the threads finish together
+	ThreadPool& pool = ThreadPool::global();
+	size_t numRanges = max<size_t>(1, min(4 * pool.size(), size / (1 << 20)));
+
+	// a range starts after the first line break at or after its nominal start, and ends where the next one starts
+	vector<size_t> starts(numRanges + 1, size);
+	starts[0] = 0;
+	for (size_t r = 1; r < numRanges; r++)
+	{
+		const char* lineBreak = static_cast<const char*>(memchr(text + r * size / numRanges, '\n', size - r * size / numRanges));
+		starts[r] = (lineBreak == nullptr) ? size : max<size_t>(starts[r - 1], lineBreak - text + 1);
+	}
+
+	vector<vector<double>> xs(numRanges);
+	vector<vector<double>> ys(numRanges);
+	vector<vector<double>> ws(numRanges);
+	pool.run(numRanges, [&](size_t r) {
+		// about 16 bytes per line
+		xs[r].reserve((starts[r + 1] - starts[r]) / 16 + 1);
+		ys[r].reserve((starts[r + 1] - starts[r]) / 16 + 1);
+		parseLines(text + starts[r], text + starts[r + 1], xs[r], ys[r], numeric_limits<size_t>::max(), weights ? &ws[r] : nullptr);
+	}, "parsing");
+
+	vector<size_t> offsets(numRanges + 1, 0);
+	for (size_t r = 0; r < numRanges; r++)
+		offsets[r + 1] = offsets[r] + xs[r].size();
+
+	PointStore store;
+	store.resize(offsets[numRanges]);
+	double* x = store.xData();
+	double* y = store.yData();
+	if (weights != nullptr)
+		weights->resize(offsets[numRanges]);
+	pool.run(numRanges, [&](size_t r) {
+		copy(xs[r].begin(), xs[r].end(), x + offsets[r]);
+		copy(ys[r].begin(), ys[r].end(), y + offsets[r]);
+		if (weights != nullptr)
+			copy(ws[r].begin(), ws[r].end(), weights->begin() + offsets[r]);
+	}, "parsing");
+	return Dataset(move(store));
+}
+
+Dataset readTextPointFile(const string& filename)
+{
+	FileBytes bytes;
+	if (!mapFile(filename, bytes))
+	{
+		cout << "Cannot read the point file " << filename << endl;
+		return Dataset();
+	}
+	return parseText(bytes);
+}
+
+PointFile readWeightedTextPointFile(const string& filename)
+{
+	PointFile result;
+	FileBytes bytes;
+	if (!mapFile(filename, bytes))
+	{
+		cout << "Cannot read the point file " << filename << endl;
+		return result;
+	}
+	result.points = parseText(bytes, &result.weights);
+
+	// unit weights are not stored
+	if (all_of(result.weights.begin(), result.weights.end(), [](double w) { return w == 1.0; }))
+		result.weights.clear();
+	return result;
+}
+
+// Reads the content of a binary point file, returns the reason if it is not valid
+static string decodeBinary(const FileBytes& bytes, PointFile& result)
+{
+	PointFileHeader header;
+	if (bytes.size < sizeof(header))
+		return "too short";
+	memcpy(&header, bytes.data, sizeof(header));
+
+	uint64_t valueSize = (header.dtype == (uint32_t)PointFileType::Float32) ? sizeof(float) : sizeof(double);
+	auto blockFits = [&](uint64_t offset, uint64_t size) {
+		return offset % 8 == 0 && offset >= sizeof(header) && offset <= bytes.size && header.count * size <= bytes.size - offset;
+	};
+
+	string error;
+	if (memcmp(header.magic, pointFileMagic, sizeof(pointFileMagic)) != 0)
+		error = "wrong magic";
+	else if (header.version != pointFileVersion)
+		error = "unsupported version " + to_string(header.version);
+	else if (header.dims != 2)
+		error = "unsupported number of dimensions " + to_string(header.dims);
+	else if (header.dtype != (uint32_t)PointFileType::Float64 && header.dtype != (uint32_t)PointFileType::Float32)
+		error = "unsupported dtype " + to_string(header.dtype);
+	else if (header.count > bytes.size || !blockFits(header.xOffset, valueSize) || !blockFits(header.yOffset, valueSize))
+		error = "the coordinates are outside of the file";
+	else if ((header.flags & PointFileHasWeights) && !blockFits(header.weightsOffset, sizeof(double)))
+		error = "the weights are outside of the file";
+	else if ((header.flags & PointFileHasLabels) && !blockFits(header.labelsOffset, sizeof(uint32_t)))
+		error = "the labels are outside of the file";
+	if (!error.empty())
+		return error;
+
+	size_t n = header.count;
+	if (header.dtype == (uint32_t)PointFileType::Float64)
+	{
+		const double* x = reinterpret_cast<const double*>(bytes.data + header.xOffset);
+		const double* y = reinterpret_cast<const double*>(bytes.data + header.yOffset);
+		result.points = Dataset(PointStore::view(x, y, n, bytes.owner));
+		result.mapped = true;
+	}
+	else
+	{
+		const float* x = reinterpret_cast<const float*>(bytes.data + header.xOffset);
+		const float* y = reinterpret_cast<const float*>(bytes.data + header.yOffset);
+		PointStore store;
+		store.resize(n);
+		copy(x, x + n, store.xData());
+		copy(y, y + n, store.yData());
+		result.points = Dataset(move(store));
+	}
+
+	if (header.flags & PointFileHasWeights)
+	{
+		const double* weights = reinterpret_cast<const double*>(bytes.data + header.weightsOffset);
+		result.weights.assign(weights, weights + n);
+	}
+	if (header.flags & PointFileHasLabels)
+	{
+		const uint32_t* labels = reinterpret_cast<const uint32_t*>(bytes.data + header.labelsOffset);
+		result.labels.assign(labels, labels + n);
+	}
+	return "";
+}
+
+PointFile readBinaryPointFile(const string& filename)
+{
+	PointFile result;
+	FileBytes bytes;
+	if (!mapFile(filename, bytes))
+	{
+		cout << "Cannot read the point file " << filename << endl;
+		return result;
+	}
+	string error = decodeBinary(bytes, result);
+	if (!error.empty())
+	{
+		cout << "Invalid point file " << filename << ": " << error << endl;
+		return PointFile();
+	}
+	return result;
+}
+
+// Writes a binary point file to an open stream
+static bool writeBinary(ostream& file, const PointStore& points, const vector<double>& weights, const vector<uint32_t>& labels)
+{
+	uint64_t n = points.size();
+	bool hasWeights = !weights.empty() && weights.size() == n;
+	bool hasLabels = !labels.empty() && labels.size() == n;
+
+	PointFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, pointFileMagic, sizeof(pointFileMagic));
+	header.version = pointFileVersion;
+	header.dims = 2;
+	header.count = n;
+	header.dtype = (uint32_t)PointFileType::Float64;
+	header.flags = (hasWeights ? PointFileHasWeights : 0) | (hasLabels ? PointFileHasLabels : 0);
+	header.xOffset = paddedBlock(1, sizeof(header));
+	header.yOffset = header.xOffset + paddedBlock(n, sizeof(double));
+	uint64_t end = header.yOffset + paddedBlock(n, sizeof(double));
+	if (hasWeights)
+	{
+		header.weightsOffset = end;
+		end += paddedBlock(n, sizeof(double));
+	}
+	if (hasLabels)
+		header.labelsOffset = end;
+
+	// writes a block and pads it with zeros
+	const char zeros[64] = {};
+	auto writeBlock = [&file, &zeros](const void* data, uint64_t bytes) {
+		file.write(static_cast<const char*>(data), bytes);
+		file.write(zeros, paddedBlock(bytes, 1) - bytes);
+	};
+	writeBlock(&header, sizeof(header));
+	writeBlock(points.xData(), n * sizeof(double));
+	writeBlock(points.yData(), n * sizeof(double));
+	if (hasWeights)
+		writeBlock(weights.data(), n * sizeof(double));
+	if (hasLabels)
+		writeBlock(labels.data(), n * sizeof(uint32_t));
+	return (bool)file;
+}
+
+bool writeBinaryPointFile(const string& filename, const PointStore& points, const vector<double>& weights, const vector<uint32_t>& labels)
+{
+	ofstream file(filename, ios::binary | ios::trunc);
+	return file && writeBinary(file, points, weights, labels);
+}
+
+// Identity of the text file a cache was made from, stored in the last 64 bytes of the cache
+struct CacheKey {
+	char magic[8];
+	uint64_t size;
+	int64_t mtime;			// nanoseconds where the file system has them
+	uint64_t contentHash;
+	uint64_t pathHash;
+	char padding[24];
+};
+
+static const char cacheMagic[8] = {'K', 'M', 'C', 'A', 'C', 'H', 'E', '1'};
+
+// 64-bit hash of a byte array, reads 8 bytes per step so it is much faster than parsing
+static uint64_t hashBytes(const char* data, size_t size)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL ^ size;
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8)
+	{
+		uint64_t word;
+		memcpy(&word, data + i, sizeof(word));
+		hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+		hash ^= hash >> 29;
+	}
+	for (; i < size; i++)
+		hash = (hash ^ (unsigned char)data[i]) * 0x100000001b3ULL;
+	return hash;
+}
+
+static CacheKey cacheKey(const string& filename, const FileBytes& text)
+{
+	CacheKey key;
+	memset(&key, 0, sizeof(key));
+	memcpy(key.magic, cacheMagic, sizeof(cacheMagic));
+	key.size = text.size;
+	key.contentHash = hashBytes(text.data, text.size);
+
+	string path = filename;
+	struct stat info;
+	if (stat(filename.c_str(), &info) == 0)
+	{
+#ifdef __linux__
+		key.mtime = (int64_t)info.st_mtim.tv_sec * 1'000'000'000 + info.st_mtim.tv_nsec;
+#else
+		key.mtime = (int64_t)info.st_mtime * 1'000'000'000;
+#endif
+	}
+#ifdef POINT_FILE_MMAP
+	char* absolute = realpath(filename.c_str(), nullptr);
+	if (absolute != nullptr)
+	{
+		path = absolute;
+		free(absolute);
+	}
+#endif
+	key.pathHash = hashBytes(path.data(), path.size());
+	return key;
+}
+
+Dataset readTextPointFileCached(const string& filename, bool& fromCache)
+{
+	fromCache = false;
+	FileBytes text;
+	if (!mapFile(filename, text))
+	{
+		cout << "Cannot read the point file " << filename << endl;
+		return Dataset();
+	}
+	CacheKey key = cacheKey(filename, text);
+	string cacheName = filename + ".kmcache";
+
+	FileBytes cache;
+	if (mapFile(cacheName, cache) && cache.size >= sizeof(PointFileHeader) + sizeof(CacheKey)
+		&& memcmp(cache.data + cache.size - sizeof(CacheKey), &key, sizeof(key)) == 0)
+	{
+		PointFile file;
+		if (decodeBinary(cache, file).empty())
+		{
+			fromCache = true;
+			return file.points;
+		}
+	}
+
+	Dataset data = parseText(text);
+
+	// written to a temporary file and renamed, so a concurrent run never maps a partly written cache
+	string temporary = cacheName + ".tmp" + to_string(chrono::steady_clock::now().time_since_epoch().count());
+	bool written;
+	{
+		ofstream file(temporary, ios::binary | ios::trunc);
+		written = file && writeBinary(file, *data, {}, {}) && file.write(reinterpret_cast<const char*>(&key), sizeof(key));
+	}
+	if (written && rename(temporary.c_str(), cacheName.c_str()) != 0)
+	{
+		// rename does not replace an existing file everywhere
+		remove(cacheName.c_str());
+		written = rename(temporary.c_str(), cacheName.c_str()) == 0;
+	}
+	if (!written)
+		remove(temporary.c_str());
+	return data;
+}
+
+PointFileReader::PointFileReader(const string& filename, size_t chunkPoints)
+: file(filename, ios::binary), chunkPoints(max<size_t>(1, chunkPoints))
+{
+	if (!this->file)
+		return;
+
+	PointFileHeader header;
+	this->binary = this->file.read(reinterpret_cast<char*>(&header), sizeof(header))
+		&& memcmp(header.magic, pointFileMagic, sizeof(pointFileMagic)) == 0;
+	if (this->binary)
+	{
+		if (header.version != pointFileVersion || header.dims != 2
+			|| (header.dtype != (uint32_t)PointFileType::Float64 && header.dtype != (uint32_t)PointFileType::Float32))
+		{
+			cout << "Unsupported point file " << filename << endl;
+			this->file.close();
+			return;
+		}
+		this->count = header.count;
+		this->float32 = (header.dtype == (uint32_t)PointFileType::Float32);
+		this->xOffset = header.xOffset;
+		this->yOffset = header.yOffset;
+	}
+	this->rewind();
+}
+
+void PointFileReader::rewind()
+{
+	this->file.clear();
+	this->file.seekg(0);
+	this->position = 0;
+	this->textBegin = 0;
+	this->textEnd = 0;
+	this->textEof = false;
+}
+
+bool PointFileReader::next(PointStore& chunk)
+{
+	if (!this->file.is_open())
+		return false;
+	return this->binary ? this->nextBinary(chunk) : this->nextText(chunk);
+}
+
+bool PointFileReader::nextBinary(PointStore& chunk)
+{
+	size_t n = (size_t)min<uint64_t>(this->chunkPoints, this->count - this->position);
+	if (n == 0)
+		return false;
+	chunk.resize(n);
+
+	// reads n values of the block at offset, float32 values are converted
+	auto readBlock = [&](uint64_t offset, double* values) {
+		size_t valueSize = this->float32 ? sizeof(float) : sizeof(double);
+		this->file.seekg(offset + this->position * valueSize);
+		if (!this->float32)
+			return (bool)this->file.read(reinterpret_cast<char*>(values), n * sizeof(double));
+		this->floats.resize(n);
+		if (!this->file.read(reinterpret_cast<char*>(this->floats.data()), n * sizeof(float)))
+			return false;
+		copy(this->floats.begin(), this->floats.end(), values);
+		return true;
+	};
+	if (!readBlock(this->xOffset, chunk.xData()) || !readBlock(this->yOffset, chunk.yData()))
+	{
+		cout << "The point file ends before its last point" << endl;
+		chunk.clear();
+		this->position = this->count;
+		return false;
+	}
+	this->position += n;
+	return true;
+}
+
+bool PointFileReader::nextText(PointStore& chunk)
+{
+	if (this->text.empty())
+		this->text.resize(1 << 20);
+	this->xs.clear();
+	this->ys.clear();
+
+	while (this->xs.size() < this->chunkPoints)
+	{
+		// complete lines in the buffer
+		const char* begin = this->text.data() + this->textBegin;
+		const char* end = this->text.data() + this->textEnd;
+		const char* lastBreak = end;
+		while (lastBreak > begin && lastBreak[-1] != '\n')
+			lastBreak--;
+		if (lastBreak > begin)
+		{
+			this->textBegin = parseLines(begin, lastBreak, this->xs, this->ys, this->chunkPoints - this->xs.size()) - this->text.data();
+			continue;
+		}
+
+		// the last line of the file may have no line break
+		if (this->textEof)
+		{
+			this->textBegin = parseLines(begin, end, this->xs, this->ys, this->chunkPoints - this->xs.size()) - this->text.data();
+			break;
+		}
+
+		// keep the incomplete line and read more, the buffer grows only for a line longer than it
+		size_t rest = this->textEnd - this->textBegin;
+		memmove(this->text.data(), begin, rest);
+		this->textBegin = 0;
+		this->textEnd = rest;
+		if (rest == this->text.size())
+			this->text.resize(2 * this->text.size());
+		this->file.read(this->text.data() + rest, this->text.size() - rest);
+		this->textEnd += (size_t)this->file.gcount();
+		this->textEof = (this->file.gcount() == 0);
+	}
+
+	chunk.resize(this->xs.size());
+	copy(this->xs.begin(), this->xs.end(), chunk.xData());
+	copy(this->ys.begin(), this->ys.end(), chunk.yData());
+	this->position += this->xs.size();
+	return !this->xs.empty();
+}
+
+PointStreamReader::PointStreamReader(int fd, size_t maxPoints)
+: fd(fd), maxPoints(max<size_t>(1, maxPoints)), text(1 << 16)
+{
+}
+
+PointStreamReader::PointStreamReader(const string& path, size_t maxPoints)
+: PointStreamReader(-1, maxPoints)
+{
+#ifdef _WIN32
+	this->fd = _open(path.c_str(), _O_RDONLY | _O_BINARY);
+#else
+	this->fd = open(path.c_str(), O_RDONLY);
+#endif
+	this->ownsFd = true;
+}
+
+PointStreamReader::~PointStreamReader()
+{
+	if (!this->ownsFd || this->fd < 0)
+		return;
+#ifdef _WIN32
+	_close(this->fd);
+#else
+	close(this->fd);
+#endif
+}
+
+bool PointStreamReader::next(PointStore& batch)
+{
+	this->xs.clear();
+	this->ys.clear();
+	if (this->fd < 0)
+		return false;
+	// drained describes the read of the previous call, every call tries at least one read of its own
+	this->drained = false;
+
+	while (this->xs.size() < this->maxPoints)
+	{
+		const char* begin = this->text.data() + this->textBegin;
+		const char* end = this->text.data() + this->textEnd;
+		const char* lastBreak = end;
+		while (lastBreak > begin && lastBreak[-1] != '\n')
+			lastBreak--;
+		if (lastBreak > begin)
+		{
+			this->textBegin = parseLines(begin, lastBreak, this->xs, this->ys, this->maxPoints - this->xs.size()) - this->text.data();
+			continue;
+		}
+		if (this->eof)
+		{
+			this->textBegin = parseLines(begin, end, this->xs, this->ys, this->maxPoints - this->xs.size()) - this->text.data();
+			break;
+		}
+		// all complete lines are parsed and the producer has nothing more yet
+		if (this->drained && !this->xs.empty())
+			break;
+
+		size_t rest = this->textEnd - this->textBegin;
+		memmove(this->text.data(), begin, rest);
+		this->textBegin = 0;
+		this->textEnd = rest;
+		if (rest == this->text.size())
+			this->text.resize(2 * this->text.size());
+		size_t wanted = this->text.size() - rest;
+#ifdef _WIN32
+		long long got = _read(this->fd, this->text.data() + rest, (unsigned int)wanted);
+#else
+		long long got = read(this->fd, this->text.data() + rest, wanted);
+#endif
+		if (got <= 0)
+		{
+			this->eof = true;
+			continue;
+		}
+		this->textEnd += (size_t)got;
+		this->drained = (size_t)got < wanted;
+	}
+
+	batch.resize(this->xs.size());
+	copy(this->xs.begin(), this->xs.end(), batch.xData());
+	copy(this->ys.begin(), this->ys.end(), batch.yData());
+	return !this->xs.empty();
+}
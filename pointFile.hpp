@@ -0,0 +1,167 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <fstream>
+
+#include "pointStore.hpp"
+
+using namespace std;
+
+// Binary point file, all fields little endian
+//
+//	offset	size	field
+//	0		8		magic "KMPOINTS"
+//	8		4		version (1)
+//	12		4		dims (2 - x and y)
+//	16		8		count - number of points
+//	24		4		dtype of the coordinates (PointFileType)
+//	28		4		flags (PointFileFlags)
+//	32		8		offset of the x block
+//	40		8		offset of the y block
+//	48		8		offset of the weights block (float64 per point), 0 without weights
+//	56		8		offset of the labels block (uint32 per point), 0 without labels
+//
+// The offsets are counted from the start of the file and are multiples of 64, every block is padded with zeros
+// to a multiple of 64 bytes. The x and y blocks have the layout of the arrays of PointStore, so the points of
+// a float64 file are used directly from the mapped pages
+struct PointFileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t dims;
+	uint64_t count;
+	uint32_t dtype;
+	uint32_t flags;
+	uint64_t xOffset;
+	uint64_t yOffset;
+	uint64_t weightsOffset;
+	uint64_t labelsOffset;
+};
+
+enum class PointFileType : uint32_t {
+	Float64 = 1,
+	Float32 = 2		// converted to float64 when the file is read
+};
+
+enum PointFileFlags : uint32_t {
+	PointFileHasWeights = 1,
+	PointFileHasLabels = 2
+};
+
+// Content of a point file
+struct PointFile {
+	Dataset points;
+	vector<double> weights;		// empty if the file has no weights
+	vector<uint32_t> labels;	// empty if the file has no labels
+	bool mapped = false;		// the points are a view of the mapped file, not a copy
+};
+
+// Reads a text point file ("x y" per line, like readPointsFromFile) on the threads of the global pool
+// The mapped file is split into byte ranges at line boundaries and every range is parsed without allocating
+// per line or per number, the ranges are then concatenated into one store
+// Lines that do not start with two numbers are skipped, returns no points if the file cannot be read
+Dataset readTextPointFile(const string& filename);
+
+// Reads a text point file with an optional weight after the coordinates ("x y [weight]" per line), e.g. the count
+// of an aggregated point. Lines without a weight weigh 1, lines with a negative weight are skipped
+// The weights are left empty if all points weigh 1
+PointFile readWeightedTextPointFile(const string& filename);
+
+// Reads a text point file through a binary cache next to it (filename + ".kmcache")
+// The cache is a binary point file followed by the key of the text file it was made from: its absolute path,
+// size, modification time and a hash of its content. If the key matches, the cache is mapped instead of
+// parsing the text, otherwise the text is parsed and the cache is written again (nothing if the directory
+// is not writable). fromCache tells which of the two happened
+Dataset readTextPointFileCached(const string& filename, bool& fromCache);
+
+// True if the file starts with the magic of a binary point file
+bool isBinaryPointFile(const string& filename);
+
+// Reads a binary point file, float64 coordinates are mapped (on POSIX systems) instead of copied
+// Prints the reason and returns no points if the file cannot be read or is not a valid point file
+PointFile readBinaryPointFile(const string& filename);
+
+// Writes the points, and the weights and labels if they are not empty, as a float64 binary point file
+// Returns false if the file cannot be written
+bool writeBinaryPointFile(const string& filename, const PointStore& points, const vector<double>& weights = {}, const vector<uint32_t>& labels = {});
+
+// Sequential reader of a point file (binary or text) in chunks of at most chunkPoints points
+// Reads through a fixed buffer instead of mapping the file, so files larger than the memory can be read
+class PointFileReader {
+
+public:
+
+	PointFileReader(const string& filename, size_t chunkPoints);
+
+	bool isOpen() const { return this->file.is_open(); };
+
+	bool isBinary() const { return this->binary; };
+
+	// Replaces the points of chunk by the next points of the file, returns false after the last point
+	bool next(PointStore& chunk);
+
+	// Continues from the first point of the file
+	void rewind();
+
+private:
+	ifstream file;
+	size_t chunkPoints;
+	uint64_t position = 0;	// points read since the start of the file
+
+	// binary file
+	bool binary = false;
+	bool float32 = false;
+	uint64_t count = 0;
+	uint64_t xOffset = 0;
+	uint64_t yOffset = 0;
+	vector<float> floats;
+
+	// text file - the lines in text[textBegin, textEnd) are not parsed yet
+	vector<char> text;
+	size_t textBegin = 0;
+	size_t textEnd = 0;
+	bool textEof = false;
+	vector<double> xs;
+	vector<double> ys;
+
+	bool nextBinary(PointStore& chunk);
+
+	bool nextText(PointStore& chunk);
+};
+
+// Reader of text points ("x y" per line) arriving on a file descriptor (stdin, a named pipe) in batches
+// A batch is returned when it has maxPoints points or when the input has no more data yet, so the points
+// a slow producer already sent are not held back until a batch is full
+// The memory is a fixed read buffer and the batch, whatever the length of the stream
+class PointStreamReader {
+
+public:
+
+	// Reads from an open file descriptor (e.g. 0 for stdin), it is not closed
+	PointStreamReader(int fd, size_t maxPoints);
+
+	// Opens a named pipe (or a file) for reading
+	PointStreamReader(const string& path, size_t maxPoints);
+
+	~PointStreamReader();
+
+	PointStreamReader(const PointStreamReader&) = delete;
+	PointStreamReader& operator=(const PointStreamReader&) = delete;
+
+	bool isOpen() const { return this->fd >= 0; };
+
+	// Replaces the points of batch by the next points, waits for at least one, returns false at the end of the stream
+	bool next(PointStore& batch);
+
+private:
+	int fd;
+	bool ownsFd = false;
+	size_t maxPoints;
+	vector<char> text;	// the lines in text[textBegin, textEnd) are not parsed yet
+	size_t textBegin = 0;
+	size_t textEnd = 0;
+	bool eof = false;
+	bool drained = false;	// the last read returned less than it asked for
+	vector<double> xs;
+	vector<double> ys;
+};
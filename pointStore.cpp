@@ -0,0 +1,333 @@
+#include "pointStore.hpp"
+#include "kmeans.hpp"
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+PointStore::PointStore(const vector<PointKmeans>& points)
+{
+	this->reserve(points.size());
+	for (const PointKmeans& p : points)
+	{
+		this->push_back(p.getX(), p.getY());
+	}
+}
+
+PointStore PointStore::view(const double* x, const double* y, size_t n, shared_ptr<const void> owner)
+{
+	PointStore store;
+	store.xView = x;
+	store.yView = y;
+	store.viewSize = n;
+	store.owner = move(owner);
+	return store;
+}
+
+void PointStore::detach()
+{
+	if (!this->owner)
+		return;
+	this->xs.assign(this->xView, this->xView + this->viewSize);
+	this->ys.assign(this->yView, this->yView + this->viewSize);
+	this->xView = nullptr;
+	this->yView = nullptr;
+	this->viewSize = 0;
+	this->owner.reset();
+}
+
+void PointStore::reserve(size_t n)
+{
+	this->detach();
+	this->xs.reserve(n);
+	this->ys.reserve(n);
+}
+
+void PointStore::push_back(double x, double y)
+{
+	this->detach();
+	this->xs.push_back(x);
+	this->ys.push_back(y);
+}
+
+void PointStore::resize(size_t n)
+{
+	this->detach();
+	this->xs.resize(n);
+	this->ys.resize(n);
+}
+
+void PointStore::clear()
+{
+	// a view is dropped, not copied
+	this->xView = nullptr;
+	this->yView = nullptr;
+	this->viewSize = 0;
+	this->owner.reset();
+	this->xs.clear();
+	this->ys.clear();
+}
+
+PointKmeans PointStore::at(size_t i) const
+{
+	return PointKmeans(this->xData()[i], this->yData()[i]);
+}
+
+vector<PointKmeans> PointStore::toPoints() const
+{
+	vector<PointKmeans> points(this->size());
+	for (size_t i = 0; i < this->size(); i++)
+	{
+		points[i] = this->at(i);
+	}
+	return points;
+}
+
+void ClusterSums::reset()
+{
+	fill(this->sumX.begin(), this->sumX.end(), 0.0);
+	fill(this->sumY.begin(), this->sumY.end(), 0.0);
+	fill(this->count.begin(), this->count.end(), 0);
+	fill(this->weight.begin(), this->weight.end(), 0.0);
+}
+
+void ClusterSums::add(const ClusterSums& other)
+{
+	for (size_t j = 0; j < this->size(); j++)
+	{
+		this->sumX[j] += other.sumX[j];
+		this->sumY[j] += other.sumY[j];
+		this->count[j] += other.count[j];
+	}
+	for (size_t j = 0; j < this->weight.size(); j++)
+	{
+		this->weight[j] += other.weight[j];
+	}
+}
+
+bool updateCentroids(const ClusterSums& sums, PointStore& centroids, double tolerance)
+{
+	bool converged = true;
+	double* cx = centroids.xData();
+	double* cy = centroids.yData();
+
+	for (size_t j = 0; j < centroids.size(); j++)
+	{
+		double total = sums.weighted() ? sums.weight[j] : sums.count[j];
+		if (total <= 0.0)
+			continue;
+
+		// compute the mean of all points in a cluster
+		double meanX = sums.sumX[j] / total;
+		double meanY = sums.sumY[j] / total;
+
+		double diff = abs(meanX - cx[j]) + abs(meanY - cy[j]);
+		if (diff > tolerance)
+			converged = false;
+
+		cx[j] = meanX;
+		cy[j] = meanY;
+	}
+	return converged;
+}
+
+LabelArray::LabelArray(size_t n, size_t k)
+{
+	this->n = n;
+	if (k <= 256)
+	{
+		this->width = 1;
+		this->labels8.resize(n);
+	}
+	else if (k <= 65536)
+	{
+		this->width = 2;
+		this->labels16.resize(n);
+	}
+	else
+	{
+		this->width = 4;
+		this->labels32.resize(n);
+	}
+}
+
+size_t LabelArray::operator[](size_t i) const
+{
+	switch (this->width)
+	{
+	case 1: return this->labels8[i];
+	case 2: return this->labels16[i];
+	default: return this->labels32[i];
+	}
+}
+
+void LabelArray::set(size_t i, size_t label)
+{
+	switch (this->width)
+	{
+	case 1: this->labels8[i] = static_cast<uint8_t>(label); break;
+	case 2: this->labels16[i] = static_cast<uint16_t>(label); break;
+	default: this->labels32[i] = static_cast<uint32_t>(label); break;
+	}
+}
+
+double sumOfSquaredDistances(const PointStore& points, const LabelArray& labels, const PointStore& centroids)
+{
+	double sum = 0.0;
+	for (size_t i = 0; i < points.size(); i++)
+	{
+		size_t a = labels[i];
+		double dx = points.xData()[i] - centroids.xData()[a];
+		double dy = points.yData()[i] - centroids.yData()[a];
+		sum += dx * dx + dy * dy;
+	}
+	return sum;
+}
+
+const char* assignmentKernelName()
+{
+#if defined(__AVX512F__)
+	return "AVX-512";
+#elif defined(__AVX2__)
+	return "AVX2";
+#else
+	return "scalar";
+#endif
+}
+
+// Scalar version of the kernel, also used for the tail of the SIMD loops
+template <typename Label>
+static double assignScalar(const double* x, const double* y, size_t begin, size_t end,
+							const double* cx, const double* cy, size_t k,
+							Label* labels, double* minDists, ClusterSums* sums)
+{
+	double sum = 0.0;
+	for (size_t i = begin; i < end; i++)
+	{
+		double min = numeric_limits<double>::max();
+		size_t minIdx = 0;
+		for (size_t j = 0; j < k; j++)
+		{
+			double dx = x[i] - cx[j];
+			double dy = y[i] - cy[j];
+			double dist = dx * dx + dy * dy;
+			if (dist < min)
+			{
+				min = dist;
+				minIdx = j;
+			}
+		}
+		labels[i] = static_cast<Label>(minIdx);
+		if (minDists) minDists[i] = min;
+		if (sums)
+		{
+			sums->sumX[minIdx] += x[i];
+			sums->sumY[minIdx] += y[i];
+			sums->count[minIdx]++;
+		}
+		sum += min;
+	}
+	return sum;
+}
+
+template <typename Label>
+double assignToNearestCentroid(const PointStore& points,
+								size_t begin,
+								size_t end,
+								const PointStore& centroids,
+								Label* labels,
+								double* minDists,
+								ClusterSums* sums)
+{
+	const double* x = points.xData();
+	const double* y = points.yData();
+	const double* cx = centroids.xData();
+	const double* cy = centroids.yData();
+	size_t k = centroids.size();
+	double sum = 0.0;
+	size_t i = begin;
+
+#if defined(__AVX512F__)
+	// 8 points per iteration, lane l holds point i + l
+	// the index of the best centroid is kept as double so it can be blended with the same mask
+	alignas(64) double bestDist[8];
+	alignas(64) double bestIdx[8];
+	for (; i + 8 <= end; i += 8)
+	{
+		__m512d px = _mm512_loadu_pd(x + i);
+		__m512d py = _mm512_loadu_pd(y + i);
+		__m512d best = _mm512_set1_pd(numeric_limits<double>::max());
+		__m512d idx = _mm512_setzero_pd();
+
+		for (size_t j = 0; j < k; j++)
+		{
+			__m512d dx = _mm512_sub_pd(px, _mm512_set1_pd(cx[j]));
+			__m512d dy = _mm512_sub_pd(py, _mm512_set1_pd(cy[j]));
+			__m512d dist = _mm512_add_pd(_mm512_mul_pd(dx, dx), _mm512_mul_pd(dy, dy));
+			__mmask8 closer = _mm512_cmp_pd_mask(dist, best, _CMP_LT_OQ);
+			best = _mm512_mask_mov_pd(best, closer, dist);
+			idx = _mm512_mask_mov_pd(idx, closer, _mm512_set1_pd(double(j)));
+		}
+
+		_mm512_store_pd(bestDist, best);
+		_mm512_store_pd(bestIdx, idx);
+		for (size_t l = 0; l < 8; l++)
+		{
+			size_t label = static_cast<size_t>(bestIdx[l]);
+			labels[i + l] = static_cast<Label>(label);
+			if (minDists) minDists[i + l] = bestDist[l];
+			if (sums)
+			{
+				sums->sumX[label] += x[i + l];
+				sums->sumY[label] += y[i + l];
+				sums->count[label]++;
+			}
+			sum += bestDist[l];
+		}
+	}
+#elif defined(__AVX2__)
+	// 4 points per iteration, lane l holds point i + l
+	alignas(32) double bestDist[4];
+	alignas(32) double bestIdx[4];
+	for (; i + 4 <= end; i += 4)
+	{
+		__m256d px = _mm256_loadu_pd(x + i);
+		__m256d py = _mm256_loadu_pd(y + i);
+		__m256d best = _mm256_set1_pd(numeric_limits<double>::max());
+		__m256d idx = _mm256_setzero_pd();
+
+		for (size_t j = 0; j < k; j++)
+		{
+			__m256d dx = _mm256_sub_pd(px, _mm256_set1_pd(cx[j]));
+			__m256d dy = _mm256_sub_pd(py, _mm256_set1_pd(cy[j]));
+			__m256d dist = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+			__m256d closer = _mm256_cmp_pd(dist, best, _CMP_LT_OQ);
+			best = _mm256_blendv_pd(best, dist, closer);
+			idx = _mm256_blendv_pd(idx, _mm256_set1_pd(double(j)), closer);
+		}
+
+		_mm256_store_pd(bestDist, best);
+		_mm256_store_pd(bestIdx, idx);
+		for (size_t l = 0; l < 4; l++)
+		{
+			size_t label = static_cast<size_t>(bestIdx[l]);
+			labels[i + l] = static_cast<Label>(label);
+			if (minDists) minDists[i + l] = bestDist[l];
+			if (sums)
+			{
+				sums->sumX[label] += x[i + l];
+				sums->sumY[label] += y[i + l];
+				sums->count[label]++;
+			}
+			sum += bestDist[l];
+		}
+	}
+#endif
+
+	sum += assignScalar(x, y, i, end, cx, cy, k, labels, minDists, sums);
+	return sum;
+}
+
+template double assignToNearestCentroid<uint8_t>(const PointStore&, size_t, size_t, const PointStore&, uint8_t*, double*, ClusterSums*);
+template double assignToNearestCentroid<uint16_t>(const PointStore&, size_t, size_t, const PointStore&, uint16_t*, double*, ClusterSums*);
+template double assignToNearestCentroid<uint32_t>(const PointStore&, size_t, size_t, const PointStore&, uint32_t*, double*, ClusterSums*);
@@ -0,0 +1,234 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <memory>
+
+using namespace std;
+
+class PointKmeans;
+
+// Allocator returning memory aligned to a cache line
+// Used for the coordinate arrays so the SIMD kernels work on aligned blocks
+template <typename T, size_t Alignment = 64>
+class AlignedAllocator {
+public:
+	typedef T value_type;
+
+	template <typename U>
+	struct rebind { typedef AlignedAllocator<U, Alignment> other; };
+
+	AlignedAllocator() {};
+
+	template <typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment>&) {};
+
+	T* allocate(size_t n) {
+		if (n == 0) return nullptr;
+		size_t bytes = ((n * sizeof(T) + Alignment - 1) / Alignment) * Alignment;
+#ifdef _MSC_VER
+		void* p = _aligned_malloc(bytes, Alignment);
+#else
+		void* p = aligned_alloc(Alignment, bytes);
+#endif
+		if (p == nullptr) throw bad_alloc();
+		return static_cast<T*>(p);
+	};
+
+	void deallocate(T* p, size_t) {
+#ifdef _MSC_VER
+		_aligned_free(p);
+#else
+		free(p);
+#endif
+	};
+
+	// Elements added without a value (resize) are left uninitialized, so the pages of a large array are first
+	// touched - and placed on a NUMA node - by the thread that fills them, not by the one that allocated them
+	template <typename U>
+	void construct(U* p) { ::new((void*)p) U; };
+
+	template <typename U, typename... Args>
+	void construct(U* p, Args&&... args) { ::new((void*)p) U(forward<Args>(args)...); };
+
+	template <typename U>
+	bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; };
+
+	template <typename U>
+	bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; };
+};
+
+template <typename T>
+using AlignedVector = vector<T, AlignedAllocator<T>>;
+
+// Structure-of-arrays storage of 2D points
+// x and y coordinates are kept in two separate contiguous arrays,
+// so the assignment kernel can load 4 (AVX2) or 8 (AVX-512) points with one instruction
+// A store is either the owner of its arrays or a read-only view of arrays owned by someone else
+// (e.g. the mapped pages of a binary point file), a view is copied into owned arrays before it is modified
+class PointStore {
+
+public:
+
+	PointStore() {};
+
+	PointStore(const vector<PointKmeans>& points);
+
+	// View of n points at x and y, owner keeps the memory alive as long as the store (or a copy of it) exists
+	static PointStore view(const double* x, const double* y, size_t n, shared_ptr<const void> owner);
+
+	void reserve(size_t n);
+
+	void push_back(double x, double y);
+
+	// New coordinates are not initialized
+	void resize(size_t n);
+
+	void clear();
+
+	size_t size() const { return this->owner ? this->viewSize : this->xs.size(); };
+
+	bool empty() const { return this->size() == 0; };
+
+	bool isView() const { return (bool)this->owner; };
+
+	const double* xData() const { return this->owner ? this->xView : this->xs.data(); };
+
+	const double* yData() const { return this->owner ? this->yView : this->ys.data(); };
+
+	double* xData() { this->detach(); return this->xs.data(); };
+
+	double* yData() { this->detach(); return this->ys.data(); };
+
+	// Returns the i-th point as PointKmeans
+	PointKmeans at(size_t i) const;
+
+	// Converts the store back to the array-of-structures representation
+	vector<PointKmeans> toPoints() const;
+
+private:
+	AlignedVector<double> xs;
+	AlignedVector<double> ys;
+
+	// view mode
+	const double* xView = nullptr;
+	const double* yView = nullptr;
+	size_t viewSize = 0;
+	shared_ptr<const void> owner;
+
+	// Copies a view into owned arrays
+	void detach();
+};
+
+// Immutable handle to a point store that is shared instead of copied
+// Any number of models and concurrent fits can read one dataset, copying the handle does not copy the points
+class Dataset {
+
+public:
+
+	Dataset() : points(make_shared<const PointStore>()) {};
+
+	// Not explicit, so the models still accept vector<PointKmeans> (the points are converted once)
+	Dataset(const vector<PointKmeans>& points) : points(make_shared<const PointStore>(points)) {};
+
+	explicit Dataset(PointStore store) : points(make_shared<const PointStore>(move(store))) {};
+
+	const PointStore& operator*() const { return *this->points; };
+
+	const PointStore* operator->() const { return this->points.get(); };
+
+	size_t size() const { return this->points->size(); };
+
+	bool empty() const { return this->points->empty(); };
+
+private:
+	shared_ptr<const PointStore> points;
+};
+
+// Per-cluster sums of the coordinates and number of points
+// Accumulated by the assignment kernel, so the means can be computed without another pass over the points
+// The arrays are aligned and padded to whole cache lines, so per-thread accumulators never share a line
+// Sums of weighted points hold the weighted coordinates and the total weight of every cluster
+struct ClusterSums {
+
+	AlignedVector<double> sumX;
+	AlignedVector<double> sumY;
+	AlignedVector<size_t> count;
+	AlignedVector<double> weight;	// empty if all points weigh 1
+
+	ClusterSums(size_t k = 0, bool weighted = false) : sumX(k, 0.0), sumY(k, 0.0), count(k, 0), weight(weighted ? k : 0, 0.0) {};
+
+	bool weighted() const { return !this->weight.empty(); };
+
+	size_t size() const { return this->count.size(); };
+
+	// Sets all sums and counts to zero without reallocating
+	void reset();
+
+	// Adds sums of another (per-thread) accumulator
+	void add(const ClusterSums& other);
+};
+
+// Moves every centroid to the (weighted) mean of its cluster, centroids of empty clusters stay where they are
+// Returns true if no centroid moved by more than tolerance (L1 distance)
+bool updateCentroids(const ClusterSums& sums, PointStore& centroids, double tolerance = 0.0001);
+
+// Per-point cluster labels stored in the smallest unsigned type that can hold k
+// (1 byte for k <= 256, 2 bytes for k <= 65536, 4 bytes otherwise)
+class LabelArray {
+
+public:
+
+	LabelArray() {};
+
+	LabelArray(size_t n, size_t k);
+
+	size_t size() const { return this->n; };
+
+	size_t bytesPerLabel() const { return this->width; };
+
+	size_t operator[](size_t i) const;
+
+	void set(size_t i, size_t label);
+
+	// Calls f with a typed pointer to the labels (uint8_t*, uint16_t* or uint32_t*)
+	template <typename F>
+	void visit(F f)
+	{
+		switch (this->width)
+		{
+		case 1: f(this->labels8.data()); break;
+		case 2: f(this->labels16.data()); break;
+		default: f(this->labels32.data()); break;
+		}
+	};
+
+private:
+	size_t n = 0;
+	size_t width = 4;
+	vector<uint8_t> labels8;
+	vector<uint16_t> labels16;
+	vector<uint32_t> labels32;
+};
+
+// Sum of the squared distances of the points to the centroids of their clusters
+double sumOfSquaredDistances(const PointStore& points, const LabelArray& labels, const PointStore& centroids);
+
+// Name of the instruction set the assignment kernel was compiled for (AVX-512, AVX2 or scalar)
+const char* assignmentKernelName();
+
+// Assigns every point with index in [begin, end) to its nearest centroid
+// labels[i] receives the index of the nearest centroid (first one on ties)
+// minDists[i] receives its squared distance, if minDists is not null
+// the coordinates of each point are added to its cluster in sums, if sums is not null
+// Returns the sum of the squared distances over the range
+template <typename Label>
+double assignToNearestCentroid(const PointStore& points,
+								size_t begin,
+								size_t end,
+								const PointStore& centroids,
+								Label* labels,
+								double* minDists = nullptr,
+								ClusterSums* sums = nullptr);
@@ -0,0 +1,157 @@
+#include "streamingKmeans.hpp"
+
+StreamingKmeans::StreamingKmeans(const string& filename, size_t k, size_t maxIter, StreamingOptions options)
+{
+	this->filename = filename;
+	this->k = k;
+	this->maxIter = maxIter;
+	this->options = options;
+	this->options.chunkPoints = max<size_t>(1, this->options.chunkPoints);
+	this->options.numThreads = max<size_t>(1, this->options.numThreads);
+}
+
+StreamingKmeans::StreamingKmeans(const string& filename, vector<PointKmeans> centroids, size_t maxIter, StreamingOptions options)
+: StreamingKmeans(filename, centroids.size(), maxIter, options)
+{
+	this->centroids = centroids;
+}
+
+void StreamingKmeans::forEachChunk(PointFileReader& reader, const function<void(const PointStore&)>& f)
+{
+	reader.rewind();
+
+	// the reader fills the buffers in turn, the caller takes them in the same order
+	PointStore buffers[2];
+	bool full[2] = {false, false};
+	bool end = false;
+	mutex bufferMutex;
+	condition_variable bufferCondition;
+
+	thread readAhead([&]() {
+		for (size_t b = 0; ; b ^= 1)
+		{
+			{
+				unique_lock<mutex> lock(bufferMutex);
+				bufferCondition.wait(lock, [&]() { return !full[b]; });
+			}
+			bool read = reader.next(buffers[b]);
+			{
+				lock_guard<mutex> lock(bufferMutex);
+				full[b] = read;
+				end = !read;
+			}
+			bufferCondition.notify_all();
+			if (!read)
+				return;
+		}
+	});
+
+	for (size_t b = 0; ; b ^= 1)
+	{
+		{
+			auto start = chrono::steady_clock::now();
+			unique_lock<mutex> lock(bufferMutex);
+			bufferCondition.wait(lock, [&]() { return full[b] || end; });
+			this->waitSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			// the chunks before the end were all taken
+			if (!full[b])
+				break;
+		}
+		f(buffers[b]);
+		{
+			lock_guard<mutex> lock(bufferMutex);
+			full[b] = false;
+		}
+		bufferCondition.notify_all();
+	}
+	readAhead.join();
+}
+
+void StreamingKmeans::initializeCentroids(PointFileReader& reader)
+{
+	static mt19937_64 mt{random_device{}()};
+	this->centroids.clear();
+	size_t seen = 0;
+	this->forEachChunk(reader, [&](const PointStore& chunk) {
+		for (size_t i = 0; i < chunk.size(); i++, seen++)
+		{
+			// point number seen replaces a random sample with probability k / (seen + 1)
+			if (this->centroids.size() < this->k)
+				this->centroids.push_back(chunk.at(i));
+			else
+			{
+				size_t j = uniform_int_distribution<size_t>(0, seen)(mt);
+				if (j < this->k)
+					this->centroids[j] = chunk.at(i);
+			}
+		}
+	});
+	this->points = seen;
+}
+
+KmeansLabelResult StreamingKmeans::k_means()
+{
+	KmeansLabelResult res;
+	PointFileReader reader(this->filename, this->options.chunkPoints);
+	if (!reader.isOpen())
+	{
+		cout << "Cannot read the point file " << this->filename << endl;
+		return res;
+	}
+	this->waitSeconds = 0.0;
+
+	if (this->centroids.empty())
+		this->initializeCentroids(reader);
+	if (this->centroids.empty())
+		return res;
+
+	size_t k = this->centroids.size();
+	size_t numThreads = this->options.numThreads;
+	PointStore centroidStore(this->centroids);
+	vector<ClusterSums> threadSums(numThreads, ClusterSums(k));
+	vector<double> threadSqDist(numThreads, 0.0);
+	vector<uint32_t> labels(this->options.chunkPoints);
+	PointStore assignedCentroids;	// centroids of the last assignment, the labels are written for them
+
+	for (size_t iter = 0; iter < this->maxIter && !res.converged; iter++)
+	{
+		for (size_t t = 0; t < numThreads; t++)
+		{
+			threadSums[t].reset();
+			threadSqDist[t] = 0.0;
+		}
+		size_t n = 0;
+		this->forEachChunk(reader, [&](const PointStore& chunk) {
+			parallelForRanges(chunk.size(), numThreads, [&](size_t t, size_t start, size_t end) {
+				threadSqDist[t] += assignToNearestCentroid(chunk, start, end, centroidStore, labels.data(), nullptr, &threadSums[t]);
+			}, "streaming");
+			n += chunk.size();
+		});
+		this->points = n;
+		assignedCentroids = centroidStore;
+
+		reduceClusterSums(threadSums);
+		res.sums = threadSums[0];
+		res.sqDist = accumulate(threadSqDist.begin(), threadSqDist.end(), 0.0);
+		res.converged = updateCentroids(res.sums, centroidStore, this->options.tolerance);
+		res.iterations = iter + 1;
+		res.distanceEvaluations += n * k;
+	}
+
+	// the labels are written once by an extra pass, not by every iteration
+	if (!this->options.labelsFile.empty() && res.iterations > 0)
+	{
+		ofstream labelsOut(this->options.labelsFile, ios::binary | ios::trunc);
+		this->forEachChunk(reader, [&](const PointStore& chunk) {
+			parallelForRanges(chunk.size(), numThreads, [&](size_t, size_t start, size_t end) {
+				assignToNearestCentroid(chunk, start, end, assignedCentroids, labels.data());
+			}, "streaming");
+			labelsOut.write(reinterpret_cast<const char*>(labels.data()), chunk.size() * sizeof(uint32_t));
+		});
+		res.distanceEvaluations += this->points * k;
+	}
+
+	res.centroids = centroidStore.toPoints();
+	this->centroids = res.centroids;
+	return res;
+}
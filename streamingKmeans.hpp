@@ -0,0 +1,56 @@
+#pragma once
+#include <vector>
+#include <string>
+
+#include "kmeans.hpp"
+#include "pointFile.hpp"
+
+using namespace std;
+
+// Settings of StreamingKmeans
+struct StreamingOptions {
+	size_t chunkPoints = 1 << 16;	// points of one chunk buffer, two buffers are in memory
+	size_t numThreads = 1;			// the points of a chunk are split into this many ranges
+	double tolerance = 0.0001;		// converged when no centroid moves by more (L1 distance)
+	string labelsFile;				// if not empty, the labels of the last assignment are written there by one extra pass (uint32 per point)
+};
+
+// Lloyd's kmeans over a point file that does not have to fit into memory (binary or text, see PointFileReader)
+// Every iteration is one sequential pass over the file. A read-ahead thread fills one chunk buffer while the
+// points of the other one are assigned, so reading overlaps with the assignment
+// The memory is the two chunk buffers, the centroids and the per-thread sums, independent of the size of the file
+// The result is the one of fit from the same centroids (up to the order of the additions)
+class StreamingKmeans {
+
+public:
+
+	// The initial centroids are k points sampled uniformly by one extra pass (reservoir sampling)
+	StreamingKmeans(const string& filename, size_t k, size_t maxIter = 1'000, StreamingOptions options = StreamingOptions());
+
+	StreamingKmeans(const string& filename, vector<PointKmeans> centroids, size_t maxIter = 1'000, StreamingOptions options = StreamingOptions());
+
+	// The result has no labels, they are written to labelsFile if it is set
+	KmeansLabelResult k_means();
+
+	vector<PointKmeans> getCentroids() { return this->centroids; };
+
+	// Number of points of the file (known after the first pass)
+	size_t getPoints() { return this->points; };
+
+	// Time the assignment waited for the read-ahead thread, summed over the passes
+	double getWaitSeconds() { return this->waitSeconds; };
+
+private:
+	string filename;
+	size_t k;
+	size_t maxIter;
+	StreamingOptions options;
+	vector<PointKmeans> centroids;
+	size_t points = 0;
+	double waitSeconds = 0.0;
+
+	// Calls f(chunk) for every chunk of the file, while the next chunk is read on another thread
+	void forEachChunk(PointFileReader& reader, const function<void(const PointStore&)>& f);
+
+	void initializeCentroids(PointFileReader& reader);
+};
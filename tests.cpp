@@ -1,4 +1,15 @@
 #include "tests.hpp"
+#include "elkanKmeans.hpp"
+#include "hamerlyKmeans.hpp"
+#include "yinyangKmeans.hpp"
+#include "kdTreeKmeans.hpp"
+#include "miniBatchKmeans.hpp"
+#include "cpuTopology.hpp"
+#include "numa.hpp"
+#include "pointFile.hpp"
+#include "streamingKmeans.hpp"
+#include "onlineKmeans.hpp"
+#include "coreset.hpp"
 
 // Colors used for the terminal output
 const string yellow = "\033[1;93m";
@@ -54,20 +65,7 @@ int getNumberOfClusters(const string& filename){
 }
 
 vector<PointKmeans> readPointsFromFile(const string& filename) {
-    vector<PointKmeans> points;
-    ifstream file(filename);
-    string line;
-
-    while (getline(file, line)) {
-        stringstream ss(line);
-        double x, y;
-        if (ss >> x >> y) {
-            PointKmeans point = PointKmeans(x, y);
-            points.push_back(point);
-        }
-    }
-
-    return points;
+    return readTextPointFile(filename)->toPoints();
 }
 
 
@@ -112,7 +110,7 @@ void writeSVGFile(vector<vector<PointKmeans>>& clusters, const string& filename,
     for (int i = 0; i < centroids.size(); i++) {
 
         for (auto& point : clusters[i]) {
-            svgFile << "<circle cx=\"" << point.getX() / fraction + offsetx << "\" cy=\"" << height - ( point.getY() / fraction + offsety ) << "\" r=\"" << pointSize << "\" fill=\"" << colors[i] << "\" />\n";
+            svgFile << "<circle cx=\"" << point.getX() / fraction + offsetx << "\" cy=\"" << height - ( point.getY() / fraction + offsety ) << "\" r=\"" << pointSize << "\" fill=\"" << colors[i % colors.size()] << "\" />\n";
         }
         svgFile << "<circle cx=\"" << centroids[i].getX() / fraction + offsetx << "\" cy=\"" << height - ( centroids[i].getY() / fraction + offsety ) << "\" r=\"" << pointSize*2 << "\" fill=\"black\" />\n";
         
@@ -123,24 +121,99 @@ void writeSVGFile(vector<vector<PointKmeans>>& clusters, const string& filename,
     cout << "Plot saved to: " << file << endl;
 }
 
+// Runs kmeans in the result mode selected in options
+// In the label mode the clusters are only built from the labels when they are needed for the plot
+pair<vector<PointKmeans>, vector<vector<PointKmeans>>> runKmeans(Kmeans& kmeans, const TestOptions& options){
+    if (!options.labels)
+        return kmeans.k_means();
+
+    KmeansLabelResult res = kmeans.k_meansLabels();
+    vector<vector<PointKmeans>> clusters;
+    if (options.plot)
+        clusters = kmeans.clustersFromLabels(res.labels);
+    return {res.centroids, clusters};
+}
+
+// Runs an accelerated version of kmeans that starts from the initial centroids of the basic version
+// Reports how many distances it computed compared to the n*k per iteration of the basic version
+// and checks its centroids against the single thread basic version if it was run
+void run_accelerated(const string& name,
+                Kmeans& engine,
+                size_t numberOfPoints,
+                size_t numberOfClusters,
+                const TestOptions& options,
+                vector<PointKmeans>& referenceCentroids,
+                const string& plotfile
+){
+    cout << name << " kmeans:" << endl;
+
+    auto start = chrono::high_resolution_clock::now();
+    KmeansLabelResult res = engine.k_meansLabels();
+    auto end = chrono::high_resolution_clock::now();
+    cout << "\t" << name << " time: " << yellow << chrono::duration<double>(end - start).count() << reset << endl;
+
+    size_t lloydEvaluations = numberOfPoints * numberOfClusters * res.iterations;
+    cout << "\tDistance computations: " << res.distanceEvaluations << " of " << lloydEvaluations
+         << " (" << 100.0 * res.distanceEvaluations / max<size_t>(lloydEvaluations, 1) << "%)" << endl;
+
+    if (options.basic && options.singleThread && res.converged){
+        bool equal = referenceCentroids.size() == res.centroids.size();
+        for (size_t i = 0; equal && i < res.centroids.size(); i++) {
+            equal = res.centroids[i].equal(referenceCentroids[i]);
+        }
+        if (equal) cout << "\tCentroids are " << green << "equal" << reset << endl;
+        else cout << "\tCentroids are " << red << "not equal" << reset << endl;
+    }
+
+    if (options.plot){
+        vector<vector<PointKmeans>> clusters = engine.clustersFromLabels(res.labels);
+        writeSVGFile(clusters, plotfile, res.centroids, name);
+    }
+
+    cout << "-----------------------------------" << endl;
+}
+
 void run_test(int numberOfClusters, 
-                vector<PointKmeans> points,
-                bool singleThread, 
-                bool parallel,
-                bool basic,
-                bool plusplus,
-                bool multiTrials,
-                bool plot,
-                string plotfile
+                Dataset data,
+                const TestOptions& options,
+                string plotfile,
+                shared_ptr<const vector<double>> weights
 ){
 
 
-    cout << "\tNumber of points: " << points.size() << endl;
+    cout << "\tNumber of points: " << data.size() << endl;
     cout << "\tNumber of clusters: " << numberOfClusters << endl;
+    cout << "\tAssignment kernel: " << assignmentKernelName() << endl;
+    const CpuTopology& topology = cpuTopology();
+    cout << "\tThreads: " << getNumThreads() << " (" << topology.logicalCpus << " logical CPUs, " << topology.affinityCpus << " in the affinity mask, ";
+    if (topology.quotaCpus > 0.0) cout << "quota " << topology.quotaCpus << " CPUs, ";
+    else cout << "no quota, ";
+    cout << topology.physicalCores << " physical cores)" << endl;
+    if (weights) cout << "\tWeighted points: total weight " << accumulate(weights->begin(), weights->end(), 0.0) << endl;
     cout << "-----------------------------------" << endl;
 
+    // versions that do not support weighted points are skipped
+    auto unweightedOnly = [&](const string& name){
+        if (weights) cout << name << " kmeans: skipped, it does not support weighted points" << endl << "-----------------------------------" << endl;
+        return !weights;
+    };
+
+    // utilization of the thread pool is reported per test
+    ThreadPool::global().resetStats();
+
+    // all versions share one copy of the points
+    if (options.numa) {
+        // every thread of the pool first touches the shard it processes
+        data = placeOnNumaNodes(data);
+        NumaBandwidth bandwidth = measureNumaBandwidth(data);
+        cout << "\tNUMA: " << bandwidth.nodes << " nodes, local read " << bandwidth.localGBs << " GB/s, ";
+        if (bandwidth.nodes > 1) cout << "remote read " << bandwidth.remoteGBs << " GB/s" << endl;
+        else cout << "no remote node" << endl;
+    }
 
-    Kmeans kmeans = Kmeans(points, numberOfClusters, 10000);
+
+    Kmeans kmeans = Kmeans(data, numberOfClusters, 10000);
+    kmeans.setWeights(weights);
     // Initialize centroids for basic kmeans
     kmeans.initializeCentroids();
     auto initCentroids = kmeans.getCentroids();
@@ -150,13 +223,13 @@ void run_test(int numberOfClusters,
     vector<vector<PointKmeans>> normalClusters;
     vector<vector<PointKmeans>> parallelClusters;
 
-    if(basic) cout << "Kmeans random initialization:" << endl;
+    if(options.basic) cout << "Kmeans random initialization:" << endl;
 
     // Single thread basic kmeans
-    if(basic && singleThread){
+    if(options.basic && options.singleThread){
         auto start = chrono::high_resolution_clock::now();
 
-        pair<vector<PointKmeans>, vector<vector<PointKmeans>>> res = kmeans.k_means();
+        pair<vector<PointKmeans>, vector<vector<PointKmeans>>> res = runKmeans(kmeans, options);
         normalCentroids = res.first;
         normalClusters = res.second;
 
@@ -165,10 +238,11 @@ void run_test(int numberOfClusters,
     }
 
     // Parallel basic kmeans
-    if (basic && parallel){
-        ParallelKmeans parallelkmeans = ParallelKmeans(points, numberOfClusters, initCentroids, 10000);
+    if (options.basic && options.parallel){
+        ParallelKmeans parallelkmeans = ParallelKmeans(data, numberOfClusters, initCentroids, 10000);
+        parallelkmeans.setWeights(weights);
         auto start = chrono::high_resolution_clock::now();
-        pair<vector<PointKmeans>, vector<vector<PointKmeans>>> res = parallelkmeans.k_means();
+        pair<vector<PointKmeans>, vector<vector<PointKmeans>>> res = runKmeans(parallelkmeans, options);
         parallelCentroids = res.first;
         parallelClusters = res.second;
         auto end = chrono::high_resolution_clock::now();
@@ -177,7 +251,7 @@ void run_test(int numberOfClusters,
 
     
     // check if the centroids of singleThread and parallel are equal
-    if (basic && singleThread && parallel){
+    if (options.basic && options.singleThread && options.parallel){
         bool equal = true;
         for (int i = 0; i < normalCentroids.size(); i++) {
             if (!normalCentroids[i].equal(parallelCentroids[i])) {
@@ -190,19 +264,92 @@ void run_test(int numberOfClusters,
     }
 
     // Plot output of basic Kmeans
-    if(basic && singleThread && plot){
+    if(options.basic && options.singleThread && options.plot){
         writeSVGFile(normalClusters, plotfile, normalCentroids, "Kmeans");
         
     }
-    if (basic && parallel && plot){
+    if (options.basic && options.parallel && options.plot){
         writeSVGFile(parallelClusters, plotfile, parallelCentroids, "ParallelKmeans");
     }
 
-    if (basic) cout << "-----------------------------------" << endl;
+    if (options.basic) cout << "-----------------------------------" << endl;
+
+    // Elkan kmeans from the same initial centroids as basic kmeans
+    if (options.elkan && unweightedOnly("Elkan")){
+        ElkanKmeans elkan = ElkanKmeans(data, numberOfClusters, initCentroids, 10000);
+        run_accelerated("Elkan", elkan, data.size(), numberOfClusters, options, normalCentroids, plotfile);
+    }
+
+    // Hamerly kmeans from the same initial centroids as basic kmeans
+    if (options.hamerly && options.singleThread && unweightedOnly("Hamerly")){
+        HamerlyKmeans hamerly = HamerlyKmeans(data, numberOfClusters, initCentroids, 10000);
+        run_accelerated("Hamerly", hamerly, data.size(), numberOfClusters, options, normalCentroids, plotfile);
+    }
+    if (options.hamerly && options.parallel && unweightedOnly("ParallelHamerly")){
+        ParallelHamerlyKmeans parallelHamerly = ParallelHamerlyKmeans(data, numberOfClusters, initCentroids, 10000);
+        run_accelerated("ParallelHamerly", parallelHamerly, data.size(), numberOfClusters, options, normalCentroids, plotfile);
+    }
+
+    // Yinyang kmeans from the same initial centroids as basic kmeans
+    if (options.yinyang && options.singleThread && unweightedOnly("Yinyang")){
+        YinyangKmeans yinyang = YinyangKmeans(data, numberOfClusters, initCentroids, 10000);
+        run_accelerated("Yinyang", yinyang, data.size(), numberOfClusters, options, normalCentroids, plotfile);
+    }
+    if (options.yinyang && options.parallel && unweightedOnly("ParallelYinyang")){
+        ParallelYinyangKmeans parallelYinyang = ParallelYinyangKmeans(data, numberOfClusters, initCentroids, 10000);
+        run_accelerated("ParallelYinyang", parallelYinyang, data.size(), numberOfClusters, options, normalCentroids, plotfile);
+    }
+
+    // Kd-tree filtering kmeans from the same initial centroids as basic kmeans
+    if (options.kdtree && options.singleThread && unweightedOnly("KdTree")){
+        KdTreeKmeans kdtree = KdTreeKmeans(data, numberOfClusters, initCentroids, 10000);
+        run_accelerated("KdTree", kdtree, data.size(), numberOfClusters, options, normalCentroids, plotfile);
+    }
+    if (options.kdtree && options.parallel && unweightedOnly("ParallelKdTree")){
+        ParallelKdTreeKmeans parallelKdtree = ParallelKdTreeKmeans(data, numberOfClusters, initCentroids, 10000);
+        run_accelerated("ParallelKdTree", parallelKdtree, data.size(), numberOfClusters, options, normalCentroids, plotfile);
+    }
+
+    // Mini-batch kmeans from the same initial centroids as basic kmeans
+    bool miniBatch = options.miniBatch && unweightedOnly("Mini-batch");
+    if (miniBatch) cout << "Mini-batch kmeans:" << endl;
 
-    KmeansPlusPlus kmeansplusplus = KmeansPlusPlus(points, numberOfClusters);
+    auto runMiniBatch = [&](const string& name, size_t numThreads){
+        MiniBatchOptions miniBatchOptions;
+        miniBatchOptions.batchSize = options.batchSize;
+        miniBatchOptions.countDecay = options.countDecay;
+        miniBatchOptions.numThreads = numThreads;
+        MiniBatchKmeans miniBatch = MiniBatchKmeans(data, numberOfClusters, initCentroids, 100, miniBatchOptions);
+
+        auto start = chrono::high_resolution_clock::now();
+        KmeansLabelResult res = miniBatch.k_meansLabels();
+        auto end = chrono::high_resolution_clock::now();
+        cout << "\t" << name << " time: " << yellow << chrono::duration<double>(end - start).count() << reset << endl;
+        cout << "\tBatches: " << miniBatch.getBatches() << " (" << double(miniBatch.getBatches() * min(options.batchSize, data.size())) / data.size() << " passes over the data)" << endl;
+        cout << "\tInertia: " << res.sqDist;
+        if (options.basic && options.singleThread)
+            cout << " (basic: " << kmeans.getSqDist() << ")";
+        cout << endl;
+
+        if (options.plot){
+            vector<vector<PointKmeans>> clusters = miniBatch.clustersFromLabels(res.labels);
+            writeSVGFile(clusters, plotfile, res.centroids, name);
+        }
+    };
+
+    if (miniBatch && options.singleThread)
+        runMiniBatch("MiniBatch", 1);
+    if (miniBatch && options.parallel)
+        runMiniBatch("ParallelMiniBatch", getNumThreads());
+
+    if (miniBatch) cout << "-----------------------------------" << endl;
+
+    KmeansPlusPlus kmeansplusplus = KmeansPlusPlus(data, numberOfClusters);
+    kmeansplusplus.setWeights(weights);
     // Initialize centroids for Kmeans++
+    auto startPlusPlus = chrono::high_resolution_clock::now();
     kmeansplusplus.initializeCentroids();
+    auto endPlusPlus = chrono::high_resolution_clock::now();
     auto initCentroidsPlusPlus = kmeansplusplus.getCentroids();
     // Initialize output variables of Kmeans++
     vector<PointKmeans> normalCentroidsPlusPLus;
@@ -210,13 +357,16 @@ void run_test(int numberOfClusters,
     vector<vector<PointKmeans>> normalClustersPlusPLus;
     vector<vector<PointKmeans>> parallelClustersPlusPLus;
     
-    if(plusplus) cout << "Kmeans++ initialization:" << endl;
+    if(options.plusplus){
+        cout << "Kmeans++ initialization:" << endl;
+        cout << "\tKmeans++ seeding time: " << yellow << chrono::duration<double>(endPlusPlus - startPlusPlus).count() << reset << endl;
+    }
 
     // Single thread Kmeans++
-    if (plusplus && singleThread){
+    if (options.plusplus && options.singleThread){
 
         auto start = chrono::high_resolution_clock::now();
-        pair<vector<PointKmeans>, vector<vector<PointKmeans>>> res = kmeansplusplus.k_means();
+        pair<vector<PointKmeans>, vector<vector<PointKmeans>>> res = runKmeans(kmeansplusplus, options);
         normalCentroidsPlusPLus = res.first;
         normalClustersPlusPLus = res.second;
         auto end = chrono::high_resolution_clock::now();
@@ -224,10 +374,11 @@ void run_test(int numberOfClusters,
     }
 
     // Parallel Kmeans++
-    if (plusplus && parallel){
-        ParallelKmeans parallelkmeansplusplus = ParallelKmeans(points, numberOfClusters, initCentroidsPlusPlus, 10000);
+    if (options.plusplus && options.parallel){
+        ParallelKmeans parallelkmeansplusplus = ParallelKmeans(data, numberOfClusters, initCentroidsPlusPlus, 10000);
+        parallelkmeansplusplus.setWeights(weights);
         auto start = chrono::high_resolution_clock::now();
-        pair<vector<PointKmeans>, vector<vector<PointKmeans>>> res = parallelkmeansplusplus.k_means();
+        pair<vector<PointKmeans>, vector<vector<PointKmeans>>> res = runKmeans(parallelkmeansplusplus, options);
         parallelCentroidsPlusPLus = res.first;
         parallelClustersPlusPLus = res.second;
         auto end = chrono::high_resolution_clock::now();
@@ -236,7 +387,7 @@ void run_test(int numberOfClusters,
     
 
     // check if the centroids of singleThread and parallel are equal
-    if (plusplus && singleThread && parallel){
+    if (options.plusplus && options.singleThread && options.parallel){
         bool equal = true;
         for (int i = 0; i < normalCentroidsPlusPLus.size(); i++) {
             if (!normalCentroidsPlusPLus[i].equal(parallelCentroidsPlusPLus[i])) {
@@ -249,22 +400,115 @@ void run_test(int numberOfClusters,
     }
 
     // Plot output of Kmeans++
-    if(plusplus && singleThread && plot){
+    if(options.plusplus && options.singleThread && options.plot){
         writeSVGFile(normalClustersPlusPLus, plotfile, normalCentroidsPlusPLus, "Kmeans++");
     }
-    if (plusplus && parallel && plot){
+    if (options.plusplus && options.parallel && options.plot){
         writeSVGFile(parallelClustersPlusPLus, plotfile, parallelCentroidsPlusPLus, "ParallelKmeans++");
     }
     
 
-    if(plusplus) cout << "-----------------------------------" << endl;
+    if(options.plusplus) cout << "-----------------------------------" << endl;
+
+    // Kmeans|| initialization followed by the same runs as Kmeans++
+    if (options.scalable){
+        cout << "Kmeans|| initialization:" << endl;
+        ScalableKmeansPlusPlus kmeansScalable = ScalableKmeansPlusPlus(data, numberOfClusters);
+        kmeansScalable.setWeights(weights);
+        auto startScalable = chrono::high_resolution_clock::now();
+        kmeansScalable.initializeCentroids();
+        auto endScalable = chrono::high_resolution_clock::now();
+        vector<PointKmeans> initCentroidsScalable = kmeansScalable.getCentroids();
+        cout << "\tKmeans|| seeding time: " << yellow << chrono::duration<double>(endScalable - startScalable).count() << reset << endl;
+
+        vector<PointKmeans> normalCentroidsScalable;
+        vector<PointKmeans> parallelCentroidsScalable;
+        if (options.singleThread){
+            auto start = chrono::high_resolution_clock::now();
+            pair<vector<PointKmeans>, vector<vector<PointKmeans>>> res = runKmeans(kmeansScalable, options);
+            auto end = chrono::high_resolution_clock::now();
+            normalCentroidsScalable = res.first;
+            cout << "\tKmeans|| time: " << yellow << chrono::duration<double>(end - start).count() << reset << endl;
+            cout << "\tInertia: " << kmeansScalable.getSqDist();
+            if (options.plusplus)
+                cout << " (Kmeans++: " << kmeansplusplus.getSqDist() << ")";
+            cout << endl;
+            if (options.plot)
+                writeSVGFile(res.second, plotfile, normalCentroidsScalable, "Kmeans||");
+        }
+        if (options.parallel){
+            ParallelKmeans parallelKmeansScalable = ParallelKmeans(data, numberOfClusters, initCentroidsScalable, 10000);
+            parallelKmeansScalable.setWeights(weights);
+            auto start = chrono::high_resolution_clock::now();
+            pair<vector<PointKmeans>, vector<vector<PointKmeans>>> res = runKmeans(parallelKmeansScalable, options);
+            auto end = chrono::high_resolution_clock::now();
+            parallelCentroidsScalable = res.first;
+            cout << "\tKmeans|| parallel time: " << yellow << chrono::duration<double>(end - start).count() << reset << endl;
+            if (options.plot)
+                writeSVGFile(res.second, plotfile, parallelCentroidsScalable, "ParallelKmeans||");
+        }
+        if (options.singleThread && options.parallel){
+            bool equal = normalCentroidsScalable.size() == parallelCentroidsScalable.size();
+            for (size_t i = 0; equal && i < normalCentroidsScalable.size(); i++)
+                equal = normalCentroidsScalable[i].equal(parallelCentroidsScalable[i]);
+            if (equal) cout << "\tCentroids are " << green << "equal" << reset << endl;
+            else cout << "\tCentroids are " << red << "not equal" << reset << endl;
+        }
+        cout << "-----------------------------------" << endl;
+    }
+
+    // the multiple trials run on the weighted points of the coreset if there is one
+    Dataset trialData = data;
+    shared_ptr<const vector<double>> trialWeights = weights;
+    size_t inertiaThreads = options.parallel ? getNumThreads() : 1;
 
-    if(multiTrials) cout << "Multiple trials: " << endl;
+    // Coreset pre-stage - weighted kmeans over a small weighted sample, its inertia is measured on all the points
+    if (options.coreset > 0){
+        cout << "Coreset kmeans:" << endl;
+        CoresetOptions coresetOptions;
+        coresetOptions.size = options.coreset;
+        coresetOptions.numThreads = inertiaThreads;
+        coresetOptions.weights = weights.get();
+
+        auto start = chrono::high_resolution_clock::now();
+        Coreset coreset = buildCoreset(data, numberOfClusters, coresetOptions);
+        auto end = chrono::high_resolution_clock::now();
+        cout << "\tCoreset build time: " << yellow << chrono::duration<double>(end - start).count() << reset
+             << " (" << coreset.points.size() << " weighted points)" << endl;
+        trialData = coreset.points;
+        trialWeights = make_shared<const vector<double>>(coreset.weights);
+
+        Kmeans coresetKmeans = Kmeans(coreset.points, numberOfClusters, 10000);
+        coresetKmeans.setWeights(coreset.weights);
+        coresetKmeans.setCentroids(coreset.centers);
+        start = chrono::high_resolution_clock::now();
+        KmeansLabelResult res = coresetKmeans.k_meansLabels();
+        end = chrono::high_resolution_clock::now();
+        cout << "\tCoreset kmeans time: " << yellow << chrono::duration<double>(end - start).count() << reset << endl;
+
+        double inertia = computeInertia(data, res.centroids, inertiaThreads, weights.get());
+        cout << "\tInertia: " << inertia << " (coreset estimate " << res.sqDist;
+        if (options.basic && options.singleThread)
+            cout << ", basic: " << kmeans.getSqDist();
+        if (options.plusplus && options.singleThread)
+            cout << ", Kmeans++: " << kmeansplusplus.getSqDist();
+        cout << ")" << endl;
+        cout << "-----------------------------------" << endl;
+    }
+
+    if(options.multiTrials) cout << "Multiple trials" << (options.coreset > 0 ? " on the coreset" : "") << ": " << endl;
+
+    // the trials of the coreset are compared by their inertia on all the points
+    auto reportTrialsInertia = [&](const vector<PointKmeans>& centroids){
+        if (options.coreset > 0 && !centroids.empty())
+            cout << "\tInertia on all points: " << computeInertia(data, centroids, inertiaThreads, weights.get()) << endl;
+    };
 
     size_t numTrials = 20;
-    Kmeans kmeansMT = Kmeans(points, numberOfClusters, 10000);
+    Kmeans kmeansMT = Kmeans(trialData, numberOfClusters, 10000);
+    kmeansMT.setWeights(trialWeights);
     // Initialize centroids for multiple trials
-    vector<vector<PointKmeans>> initCentroidsMT = kmeans.initializeCentroidsForMultipleTrials(numTrials);
+    vector<vector<PointKmeans>> initCentroidsMT = kmeansMT.initializeCentroidsForMultipleTrials(numTrials);
     
     // Initialize output variables of multiple trials
     vector<PointKmeans> normalCentroidsMT;
@@ -273,29 +517,32 @@ void run_test(int numberOfClusters,
     vector<vector<PointKmeans>> parallelClustersMT;
 
     // Single thread multiple trials
-    if (multiTrials && singleThread){
+    if (options.multiTrials && options.singleThread){
         auto start = chrono::high_resolution_clock::now();
         pair<vector<PointKmeans>, vector<vector<PointKmeans>>> res = kmeansMT.k_meansMultipleTrials(numTrials, initCentroidsMT);
         normalCentroidsMT = res.first;
         normalClustersMT = res.second;
         auto end = chrono::high_resolution_clock::now();
         cout << "\tKmeans multiple trials time: " << yellow << chrono::duration<double>(end - start).count() << reset << endl;
+        reportTrialsInertia(normalCentroidsMT);
     }
 
     // Parallel multiple trials
-    if (multiTrials && parallel){
-        Kmeans parallelkmeansMT = Kmeans(points, numberOfClusters, 10000);
+    if (options.multiTrials && options.parallel){
+        Kmeans parallelkmeansMT = Kmeans(trialData, numberOfClusters, 10000);
+        parallelkmeansMT.setWeights(trialWeights);
         auto start = chrono::high_resolution_clock::now();
         pair<vector<PointKmeans>, vector<vector<PointKmeans>>> res = parallelkmeansMT.k_meansParallelMultipleTrials(numTrials, initCentroidsMT);
         parallelCentroidsMT = res.first;
         parallelClustersMT = res.second;
         auto end = chrono::high_resolution_clock::now();
         cout << "\tKmeans parallel multiple trials time: " << yellow << chrono::duration<double>(end - start).count() << reset << endl;
+        reportTrialsInertia(parallelCentroidsMT);
     }
 
 
     // check if the centroids of singleThread and parallel are equal
-    if (multiTrials && singleThread && parallel){
+    if (options.multiTrials && options.singleThread && options.parallel){
         bool equal = true;
         for (int i = 0; i < normalCentroidsMT.size(); i++) {
             if (!normalCentroidsMT[i].equal(parallelCentroidsMT[i])) {
@@ -307,13 +554,67 @@ void run_test(int numberOfClusters,
         else cout << "\tCentroids are " << red << "not equal" << reset << endl;
     }
 
+    // Batched multiple trials - one pass over the data per iteration for all trials
+    if (options.multiTrials){
+        Kmeans batchedkmeansMT = Kmeans(trialData, numberOfClusters, 10000);
+        batchedkmeansMT.setWeights(trialWeights);
+        size_t batchedThreads = options.parallel ? getNumThreads() : 1;
+        auto start = chrono::high_resolution_clock::now();
+        pair<vector<PointKmeans>, vector<vector<PointKmeans>>> res = batchedkmeansMT.k_meansBatchedMultipleTrials(numTrials, initCentroidsMT, batchedThreads);
+        auto end = chrono::high_resolution_clock::now();
+        cout << "\tKmeans batched multiple trials time (" << batchedThreads << " threads): " << yellow << chrono::duration<double>(end - start).count() << reset << endl;
+        reportTrialsInertia(res.first);
+
+        // compare with the trials run one by one
+        vector<PointKmeans>& referenceCentroidsMT = options.singleThread ? normalCentroidsMT : parallelCentroidsMT;
+        bool equal = referenceCentroidsMT.size() == res.first.size();
+        for (size_t i = 0; equal && i < res.first.size(); i++)
+            equal = referenceCentroidsMT[i].equal(res.first[i]);
+        if (equal) cout << "\tBatched centroids are " << green << "equal" << reset << endl;
+        else cout << "\tBatched centroids are " << red << "not equal" << reset << endl;
+    }
+
+    // Racing multiple trials - hopeless trials are abandoned after a few iterations
+    if (options.multiTrials && options.racing){
+        Kmeans racingkmeansMT = Kmeans(trialData, numberOfClusters, 10000);
+        racingkmeansMT.setWeights(trialWeights);
+        TrialRace race(options.racingMargin);
+        auto start = chrono::high_resolution_clock::now();
+        pair<vector<PointKmeans>, vector<vector<PointKmeans>>> res = racingkmeansMT.k_meansParallelMultipleTrials(numTrials, initCentroidsMT, &race);
+        auto end = chrono::high_resolution_clock::now();
+        cout << "\tKmeans racing multiple trials time: " << yellow << chrono::duration<double>(end - start).count() << reset << endl;
+        cout << "\tPruned trials: " << race.getPruned() << " of " << numTrials << ", CPU time saved: " << yellow << race.getSavedSeconds() << reset << endl;
+        reportTrialsInertia(res.first);
+
+        // compare with the trials run to convergence
+        vector<PointKmeans>& referenceCentroidsMT = options.singleThread ? normalCentroidsMT : parallelCentroidsMT;
+        bool equal = referenceCentroidsMT.size() == res.first.size();
+        for (size_t i = 0; equal && i < res.first.size(); i++)
+            equal = referenceCentroidsMT[i].equal(res.first[i]);
+        if (equal) cout << "\tRacing centroids are " << green << "equal" << reset << endl;
+        else cout << "\tRacing centroids are " << red << "not equal" << reset << " (sqDist " << racingkmeansMT.getSqDist() << ")" << endl;
+    }
+
     // Plot output of multiple trials
-    if(multiTrials && singleThread && plot){
+    if(options.multiTrials && options.singleThread && options.plot){
         writeSVGFile(normalClustersMT, plotfile, normalCentroidsMT, "KmeansMT");
     }
-    if (multiTrials && parallel && plot){
+    if (options.multiTrials && options.parallel && options.plot){
         writeSVGFile(parallelClustersMT, plotfile, parallelCentroidsMT, "KmeansParallelMT");
     }
+
+    // time the threads of the pool spent working in each parallel phase
+    if (options.parallel){
+        if (options.multiTrials) cout << "-----------------------------------" << endl;
+        cout << "Thread pool (" << ThreadPool::global().size() << " threads, " << ThreadPool::global().getStolenTasks() << " stolen tasks) utilization:" << endl;
+        for (const ThreadPool::PhaseStats& stats : ThreadPool::global().getStats()){
+            cout << "\t" << stats.phase << ": " << yellow << 100.0 * stats.utilization() << "%" << reset;
+            // jobs that start nested jobs are also reported with the time of the nested ones
+            if (stats.inclusiveSeconds > stats.busySeconds * 1.001)
+                cout << ", " << 100.0 * stats.inclusiveUtilization() << "% with nested jobs";
+            cout << " (" << stats.jobs << " jobs, " << stats.tasks << " tasks, " << stats.wallSeconds << " s)" << endl;
+        }
+    }
     
     cout << magenta << "-----------------------------------" << reset << endl;
 
@@ -341,12 +642,7 @@ void savePointsToFile(const string& filename, vector<PointKmeans>& points, int n
 
 void run_test_random(int numberOfPoints,
                     int numberOfClusters,
-                    bool singleThread,
-                    bool parallel,
-                    bool basic,
-                    bool plusplus,
-                    bool multiTrials,
-                    bool plot,
+                    const TestOptions& options,
                     bool save,
                     string savefile,
                     string plotfile
@@ -366,69 +662,149 @@ void run_test_random(int numberOfPoints,
     // Run the test
     run_test(numberOfClusters,
             points,
-            singleThread,
-            parallel,
-            basic,
-            plusplus,
-            multiTrials,
-            plot,
+            options,
             plotfile);
 }
 
+// Streaming kmeans reads the file again in every iteration, the loaded points only give the reference result
+void run_streaming(const string& filename,
+                Dataset data,
+                size_t numberOfClusters,
+                const TestOptions& options
+){
+    cout << "Streaming kmeans:" << endl;
+    Kmeans init = Kmeans(data, numberOfClusters);
+    init.initializeCentroids();
+    vector<PointKmeans> initCentroids = init.getCentroids();
+    KmeansLabelResult reference = fit(data, initCentroids);
+
+    auto runStreaming = [&](const string& name, size_t numThreads){
+        StreamingOptions streamingOptions;
+        streamingOptions.chunkPoints = options.chunkPoints;
+        streamingOptions.numThreads = numThreads;
+        streamingOptions.labelsFile = options.spillLabels;
+        StreamingKmeans streaming = StreamingKmeans(filename, initCentroids, 1'000, streamingOptions);
+
+        auto start = chrono::high_resolution_clock::now();
+        KmeansLabelResult res = streaming.k_means();
+        auto end = chrono::high_resolution_clock::now();
+        cout << "\t" << name << " time: " << yellow << chrono::duration<double>(end - start).count() << reset << endl;
+        cout << "\tPasses: " << res.iterations << ", chunk buffers: 2 x " << streamingOptions.chunkPoints << " points, waited for reading: "
+             << streaming.getWaitSeconds() << " s" << endl;
+        cout << "\tInertia: " << res.sqDist << " (in memory: " << reference.sqDist << ")" << endl;
+
+        bool equal = res.converged == reference.converged && res.centroids.size() == reference.centroids.size();
+        for (size_t i = 0; equal && i < res.centroids.size(); i++) {
+            equal = res.centroids[i].equal(reference.centroids[i]);
+        }
+        if (equal) cout << "\tCentroids are " << green << "equal" << reset << endl;
+        else cout << "\tCentroids are " << red << "not equal" << reset << endl;
+
+        if (!options.spillLabels.empty()){
+            ifstream labelsIn(options.spillLabels, ios::binary);
+            size_t differ = 0;
+            uint32_t label;
+            for (size_t i = 0; i < reference.labels.size(); i++) {
+                differ += !labelsIn.read(reinterpret_cast<char*>(&label), sizeof(label)) || label != reference.labels[i];
+            }
+            cout << "\tSpilled labels: " << differ << " differ from the in-memory labels" << endl;
+        }
+    };
+
+    if (options.singleThread)
+        runStreaming("Streaming", 1);
+    if (options.parallel)
+        runStreaming("ParallelStreaming", getNumThreads());
+
+    cout << "-----------------------------------" << endl;
+}
+
 void run_test_file(const string& filename,
-                    bool singleThread,
-                    bool parallel,
-                    bool basic,
-                    bool plusplus,
-                    bool multiTrials,
-                    bool plot
+                    const TestOptions& options
                     ){
     
     // Read the info and points from the file
-    int numberOfClusters = getNumberOfClusters(filename);
-    vector<PointKmeans> points = readPointsFromFile(filename);
+    int numberOfClusters = options.clusters > 0 ? options.clusters : getNumberOfClusters(filename);
+
+    // binary point files are mapped, text files are parsed in parallel
+    auto start = chrono::high_resolution_clock::now();
+    Dataset data;
+    shared_ptr<const vector<double>> weights;
+    bool binary = isBinaryPointFile(filename);
+    bool fromCache = false;
+    if (binary){
+        PointFile pointFile = readBinaryPointFile(filename);
+        data = pointFile.points;
+        if (!pointFile.weights.empty())
+            weights = make_shared<const vector<double>>(move(pointFile.weights));
+    }
+    else if (options.parseCache)
+        data = readTextPointFileCached(filename, fromCache);
+    else
+        data = readTextPointFile(filename);
+    auto end = chrono::high_resolution_clock::now();
+    double loadTime = chrono::duration<double>(end - start).count();
 
     // Extract the filename for the output
-    string fileInfo = filename.substr(6); // remove "input/"
-    fileInfo = fileInfo.substr(0, fileInfo.size() - 4); // remove ".txt"
+    string fileInfo = filename.substr(filename.find_last_of("/\\") + 1); // remove the directory
+    fileInfo = fileInfo.substr(0, fileInfo.find_last_of('.')); // remove the extension
 
     cout << magenta << "-----------------------------------" << reset << endl;
     cout << "Running test for file: " << fileInfo << endl;
+    cout << "\tLoad time: " << yellow << loadTime << reset;
+    if (binary) cout << " (binary)" << endl;
+    else if (fromCache) cout << " (text, from the cache)" << endl;
+    else cout << " (text, " << ifstream(filename, ios::binary | ios::ate).tellg() / (loadTime * 1e6) << " MB/s)" << endl;
 
     // Run the test
     run_test(numberOfClusters,
-            points,
-            singleThread,
-            parallel,
-            basic,
-            plusplus,
-            multiTrials,
-            plot,
-            fileInfo);
+            data,
+            options,
+            fileInfo,
+            weights);
+
+    // the streaming version reads only the coordinates of the file
+    if (options.streaming && !weights)
+        run_streaming(filename, data, numberOfClusters, options);
 }
 
-void run_tests_for_all_files(
-                    bool singleThread,
-                    bool parallel,
-                    bool basic,
-                    bool plusplus,
-                    bool multiTrials,
-                    bool plot
-){
+void run_tests_for_all_files(const TestOptions& options){
 
     // Run tests for all files
     for (int i = 1; i <= 9; i++){
         FILES file = static_cast<FILES>(i);
         string filename = getFilename(file);
         cout << i << " ";
-        run_test_file(filename,
-                    singleThread,
-                    parallel,
-                    basic,
-                    plusplus,
-                    multiTrials,
-                    plot);
+        run_test_file(filename, options);
         cout << endl;
     }
 
 }
+
+void run_online(int numberOfClusters, const TestOptions& options){
+
+    OnlineOptions onlineOptions;
+    onlineOptions.batchSize = options.batchSize;
+    onlineOptions.countDecay = options.countDecay;
+    onlineOptions.snapshotPoints = options.snapshotPoints;
+    onlineOptions.numThreads = options.parallel ? getNumThreads() : 1;
+    OnlineKmeans online = OnlineKmeans(numberOfClusters, onlineOptions);
+
+    unique_ptr<PointStreamReader> reader;
+    if (options.onlineInput.empty()) reader.reset(new PointStreamReader(0, options.batchSize));
+    else reader.reset(new PointStreamReader(options.onlineInput, options.batchSize));
+    if (!reader->isOpen()){
+        cout << "Cannot open " << options.onlineInput << endl;
+        return;
+    }
+
+    auto start = chrono::high_resolution_clock::now();
+    online.run(*reader, [&](const vector<PointKmeans>& centroids, size_t points){
+        double elapsed = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+        cout << "Snapshot after " << points << " points (" << online.getBatches() << " batches, " << elapsed << " s):" << endl;
+        for (const PointKmeans& c : centroids) {
+            cout << "\t" << c.getX() << " " << c.getY() << endl;
+        }
+        cout.flush();
+    });
+}
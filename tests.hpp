@@ -31,50 +31,64 @@ int getNumberOfClusters(const string& filename);
 // Function to save the points to a file
 void savePointsToFile(const string& filename, vector<PointKmeans>& points, int numberOfClusters);
 
-// Function to read the points from a file
+// Function to read the points from a text file (parsed by readTextPointFile)
 vector<PointKmeans> readPointsFromFile(const string& filename);
 
+// Options selecting the versions of the algorithm that are run and their output
+struct TestOptions {
+    bool singleThread = false;
+    bool parallel = false;
+    bool basic = false;
+    bool plusplus = false;
+    bool scalable = false;  // run the versions initialized by Kmeans|| (singleThread and/or parallel)
+    bool multiTrials = false;
+    bool racing = false;        // abandon the hopeless trials of the multiple trials version
+    double racingMargin = 0.05; // a trial is abandoned once its sqDist is this much worse than the best converged one
+    bool miniBatch = false;
+    size_t batchSize = 1024;    // batch size of the mini-batch version
+    double countDecay = 1.0;    // decay of the per-centroid counts of the mini-batch version
+    bool plot = false;
+    bool labels = false;    // use the label result mode instead of copying the points into clusters
+    bool elkan = false;     // run Elkan kmeans from the initial centroids of the basic version
+    bool hamerly = false;   // run Hamerly kmeans (singleThread and/or parallel) from the initial centroids of the basic version
+    bool yinyang = false;   // run Yinyang kmeans (singleThread and/or parallel) from the initial centroids of the basic version
+    bool kdtree = false;    // run kd-tree filtering kmeans (singleThread and/or parallel) from the initial centroids of the basic version
+    int clusters = 0;       // if greater than 0, overrides the number of clusters given by the file name
+    bool numa = false;      // place the shards of the points on the NUMA nodes of the threads (see setNumaMode)
+    bool parseCache = true; // read text input files through their binary cache (see readTextPointFileCached)
+    bool streaming = false;     // run streaming kmeans over the input file (singleThread and/or parallel)
+    size_t chunkPoints = 65536; // points of a chunk buffer of the streaming version
+    string spillLabels;         // if not empty, the streaming version writes its labels to this file
+    size_t coreset = 0;         // if greater than 0, run weighted kmeans and the multiple trials over a coreset of about this many points
+    string onlineInput;         // named pipe (or file) of the online mode, empty - stdin
+    size_t snapshotPoints = 100000; // points between two centroid snapshots of the online mode
+};
+
 // Function to run an arbitrary test
+//  - weights are the optional per-point weights (e.g. of a binary point file), the versions without weights are skipped
 void run_test(int numberOfClusters, 
-                vector<PointKmeans> points,
-                bool singleThread, 
-                bool parallel,
-                bool basic,
-                bool plusplus,
-                bool multi_trials,
-                bool plot,
-                string plotfile);
+                Dataset data,
+                const TestOptions& options,
+                string plotfile,
+                shared_ptr<const vector<double>> weights = nullptr);
 
 // Function to run a test with random points 
 //  - generates points and runs the test
 void run_test_random(int numberOfPoints,
                     int numberOfClusters,
-                    bool singleThread,
-                    bool parallel,
-                    bool basic,
-                    bool plusplus,
-                    bool multi_trials,
-                    bool plot,
+                    const TestOptions& options,
                     bool save,
                     string savefile,
                     string plotfile);
 
 // Function to run a test with points from a file 
-//  - reads points from a file and runs the test
+//  - reads points from a text or binary point file (detected from the content) and runs the test
 void run_test_file(const string& filename,
-                    bool singleThread,
-                    bool parallel,
-                    bool basic,
-                    bool plusplus,
-                    bool multi_trials,
-                    bool plot);
+                    const TestOptions& options);
 
 // Function to run tests for all test files defined in FILES enum
-void run_tests_for_all_files(
-                    bool singleThread,
-                    bool parallel,
-                    bool basic,
-                    bool plusplus,
-                    bool multi_trials,
-                    bool plot);
+void run_tests_for_all_files(const TestOptions& options);
 
+// Function to run online kmeans over the points read from stdin or options.onlineInput
+//  - prints a snapshot of the centroids every options.snapshotPoints points and at the end of the stream
+void run_online(int numberOfClusters, const TestOptions& options);
@@ -0,0 +1,445 @@
+#include "threadPool.hpp"
+#include "cpuTopology.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <tuple>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+// queue of the worker running on this thread, threads outside the pool use queue 0
+static thread_local size_t workerQueue = 0;
+static thread_local const void* workerPool = nullptr;
+// time this thread spent in the tasks that are running inside the current task
+static thread_local long long nestedNanoseconds = 0;
+// group of the task running on this thread (a ThreadPool::TaskGroup), parent of the jobs it starts
+static thread_local const void* currentGroup = nullptr;
+
+// Restricts the calling thread to the given CPUs (nothing if the list is empty or not on Linux)
+static void pinCurrentThread(const vector<int>& cpus)
+{
+#ifdef __linux__
+	if (cpus.empty())
+		return;
+	cpu_set_t mask;
+	CPU_ZERO(&mask);
+	for (int cpu : cpus)
+		if (cpu >= 0 && cpu < CPU_SETSIZE)
+			CPU_SET(cpu, &mask);
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+}
+
+ThreadPool::ThreadPool(size_t numThreads, vector<ThreadPlacement> placement)
+: placement(move(placement))
+{
+	numThreads = max<size_t>(1, numThreads);
+	this->placed = !this->placement.empty();
+	this->placement.resize(numThreads);
+	for (const ThreadPlacement& p : this->placement)
+		this->nodes = max(this->nodes, p.node + 1);
+	for (size_t t = 0; t < numThreads; t++)
+		this->queues.emplace_back(new WorkQueue());
+	this->workers.reserve(numThreads - 1);
+	for (size_t t = 1; t < numThreads; t++)
+		this->workers.emplace_back(&ThreadPool::workerLoop, this, t);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		lock_guard<mutex> lock(this->stateMutex);
+		this->stopping = true;
+	}
+	this->wakeCondition.notify_all();
+	for (auto& worker : this->workers)
+		worker.join();
+}
+
+static mutex globalMutex;
+static unique_ptr<ThreadPool> globalPool;
+static size_t requestedThreads = 0;	// 0 - detected by cpuTopology
+static bool numaMode = false;
+static AffinityPolicy affinityPolicy = AffinityPolicy::None;
+static vector<int> affinityCpus;	// CPUs of the List policy
+
+static size_t numThreadsLocked()
+{
+	return (requestedThreads > 0) ? requestedThreads : cpuTopology().usableThreads;
+}
+
+// Placement of the threads of the global pool, empty if they are not pinned
+static vector<ThreadPool::ThreadPlacement> placementLocked()
+{
+	vector<ThreadPool::ThreadPlacement> placement;
+	const CpuTopology& topology = cpuTopology();
+	size_t numThreads = numThreadsLocked();
+
+	if (affinityPolicy != AffinityPolicy::None)
+	{
+		vector<CpuInfo> order = topology.cpus;
+		if (affinityPolicy == AffinityPolicy::Compact)
+		{
+			sort(order.begin(), order.end(), [](const CpuInfo& a, const CpuInfo& b) {
+				return make_tuple(a.node, a.package, a.core, a.cpu) < make_tuple(b.node, b.package, b.core, b.cpu);
+			});
+		}
+		else if (affinityPolicy == AffinityPolicy::Scatter)
+		{
+			// rank of every CPU among the SMT siblings of its core and of its core among the cores of its package
+			map<pair<int, int>, int> siblings;
+			map<int, map<int, int>> coresOfPackage;
+			for (const CpuInfo& info : order)
+				coresOfPackage[info.package].emplace(info.core, (int)coresOfPackage[info.package].size());
+			vector<tuple<int, int, int, size_t>> keys;
+			for (size_t i = 0; i < order.size(); i++)
+				keys.emplace_back(siblings[{order[i].package, order[i].core}]++, coresOfPackage[order[i].package][order[i].core], order[i].package, i);
+			sort(keys.begin(), keys.end());
+			vector<CpuInfo> scattered;
+			for (const auto& key : keys)
+				scattered.push_back(order[get<3>(key)]);
+			order = scattered;
+		}
+		else
+		{
+			order.clear();
+			for (int cpu : affinityCpus)
+			{
+				CpuInfo info;
+				info.cpu = cpu;
+				auto it = find_if(topology.cpus.begin(), topology.cpus.end(), [cpu](const CpuInfo& c) { return c.cpu == cpu; });
+				if (it != topology.cpus.end())
+					info = *it;
+				order.push_back(info);
+			}
+		}
+
+		// without a known CPU the threads are placed (stable ranges) but not pinned
+		placement.resize(numThreads);
+		for (size_t t = 0; t < numThreads && !order.empty(); t++)
+		{
+			const CpuInfo& info = order[t % order.size()];
+			placement[t].cpus = {info.cpu};
+			placement[t].node = info.node;
+		}
+		return placement;
+	}
+
+	if (!numaMode)
+		return placement;
+	placement.resize(numThreads);
+	for (size_t t = 0; t < numThreads; t++)
+	{
+		placement[t].node = t * topology.numaNodes.size() / numThreads;
+		placement[t].cpus = topology.numaNodes[placement[t].node];
+	}
+	return placement;
+}
+
+static void resetGlobalPoolLocked()
+{
+	globalPool.reset();
+	globalPool.reset(new ThreadPool(numThreadsLocked(), placementLocked()));
+}
+
+ThreadPool& ThreadPool::global()
+{
+	lock_guard<mutex> lock(globalMutex);
+	if (!globalPool)
+		resetGlobalPoolLocked();
+	return *globalPool;
+}
+
+void setNumThreads(size_t numThreads)
+{
+	lock_guard<mutex> lock(globalMutex);
+	requestedThreads = numThreads;
+	if (globalPool && globalPool->size() != numThreadsLocked())
+		resetGlobalPoolLocked();
+}
+
+// Pins the calling thread like thread 0 of the pool, as it runs the tasks of thread 0
+// Without a placement it gets back the mask it had before it was first pinned
+static void pinCallingThreadLocked()
+{
+	vector<ThreadPool::ThreadPlacement> placement = placementLocked();
+	if (!placement.empty() && !placement[0].cpus.empty())
+		pinCurrentThread(placement[0].cpus);
+	else
+		pinCurrentThread(cpuTopology().affinityMask);
+}
+
+void setNumaMode(bool enabled)
+{
+	lock_guard<mutex> lock(globalMutex);
+	numaMode = enabled;
+	pinCallingThreadLocked();
+	if (globalPool)
+		resetGlobalPoolLocked();
+}
+
+void setAffinityPolicy(AffinityPolicy policy, vector<int> cpus)
+{
+	lock_guard<mutex> lock(globalMutex);
+	affinityPolicy = policy;
+	affinityCpus = move(cpus);
+	pinCallingThreadLocked();
+	if (globalPool)
+		resetGlobalPoolLocked();
+}
+
+bool getNumaMode()
+{
+	lock_guard<mutex> lock(globalMutex);
+	return numaMode;
+}
+
+size_t getNumThreads()
+{
+	lock_guard<mutex> lock(globalMutex);
+	return numThreadsLocked();
+}
+
+size_t ThreadPool::queueIndex() const
+{
+	return (workerPool == this) ? workerQueue : 0;
+}
+
+void ThreadPool::notifyAll()
+{
+	{
+		lock_guard<mutex> lock(this->stateMutex);
+		this->version++;
+	}
+	this->wakeCondition.notify_all();
+}
+
+void ThreadPool::workerLoop(size_t index)
+{
+	workerQueue = index;
+	workerPool = this;
+	pinCurrentThread(this->placement[index].cpus);
+	while (true)
+	{
+		size_t seenVersion;
+		{
+			lock_guard<mutex> lock(this->stateMutex);
+			if (this->stopping)
+				return;
+			seenVersion = this->version;
+		}
+
+		if (this->runOneTask(index))
+			continue;
+
+		// no work - sleep until a job is started (or the pool is destroyed)
+		unique_lock<mutex> lock(this->stateMutex);
+		this->wakeCondition.wait(lock, [&]() { return this->stopping || this->version != seenVersion; });
+	}
+}
+
+bool ThreadPool::claimable(const TaskGroup& group, size_t self, const TaskGroup* within)
+{
+	if (group.bound)
+		return self < group.numTasks && !group.claimed[self].load();
+	if (group.next.load() >= group.numTasks)
+		return false;
+	if (within == nullptr)
+		return true;
+
+	// the parents of a group with unclaimed tasks are still running, their owners wait for it
+	for (const TaskGroup* g = &group; g != nullptr; g = g->parent)
+		if (g == within)
+			return true;
+	return false;
+}
+
+shared_ptr<ThreadPool::TaskGroup> ThreadPool::findWork(size_t self, const TaskGroup* within)
+{
+	// own queue - the newest group first, it is the innermost job and its data is in the cache
+	// groups whose tasks are all claimed are dropped, a bound group may still have tasks of the other threads
+	{
+		WorkQueue& queue = *this->queues[self];
+		lock_guard<mutex> lock(queue.queueMutex);
+		while (!queue.groups.empty() && queue.groups.back()->next.load() >= queue.groups.back()->numTasks)
+			queue.groups.pop_back();
+		for (auto it = queue.groups.rbegin(); it != queue.groups.rend(); ++it)
+			if (claimable(**it, self, within))
+				return *it;
+	}
+
+	// steal from the other queues - the oldest group first, it is the largest piece of work
+	for (size_t offset = 1; offset < this->queues.size(); offset++)
+	{
+		WorkQueue& queue = *this->queues[(self + offset) % this->queues.size()];
+		lock_guard<mutex> lock(queue.queueMutex);
+		while (!queue.groups.empty() && queue.groups.front()->next.load() >= queue.groups.front()->numTasks)
+			queue.groups.pop_front();
+		for (const shared_ptr<TaskGroup>& group : queue.groups)
+			if (claimable(*group, self, within))
+				return group;
+	}
+	return nullptr;
+}
+
+bool ThreadPool::runOneTask(size_t self, const TaskGroup* within)
+{
+	shared_ptr<TaskGroup> group = this->findWork(self, within);
+	if (!group)
+		return false;
+
+	size_t i;
+	if (group->bound)
+	{
+		// only this thread claims its task, the group is exhausted when every thread claimed its own
+		if (group->claimed[self].exchange(true))
+			return true;
+		i = self;
+		group->next++;
+	}
+	else
+	{
+		i = group->next.fetch_add(1);
+		if (i >= group->numTasks)
+			return true;	// another thread took the last task, look again
+		if (group->owner != self)
+			this->stolenTasks++;
+	}
+
+	// the time of the tasks run inside this one (nested jobs, helping while waiting) counts for their own jobs
+	long long outerNested = nestedNanoseconds;
+	const void* outerGroup = currentGroup;
+	nestedNanoseconds = 0;
+	currentGroup = group.get();
+	auto start = chrono::steady_clock::now();
+	(*group->task)(i);
+	long long elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+	group->busyNanoseconds += elapsed - nestedNanoseconds;
+	group->inclusiveNanoseconds += elapsed;
+	nestedNanoseconds = outerNested + elapsed;
+	currentGroup = outerGroup;
+
+	// the owner may be waiting for the last task
+	if (group->done.fetch_add(1) + 1 == group->numTasks)
+		this->notifyAll();
+	return true;
+}
+
+void ThreadPool::run(size_t numTasks, const function<void(size_t)>& task, const string& phase)
+{
+	if (numTasks == 0)
+		return;
+
+	auto start = chrono::steady_clock::now();
+
+	// small job or no workers - run it on the calling thread
+	if (numTasks == 1 || this->workers.empty())
+	{
+		long long outerNested = nestedNanoseconds;
+		nestedNanoseconds = 0;
+		for (size_t i = 0; i < numTasks; i++)
+			task(i);
+		long long elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+		this->addStats(phase, numTasks, 1, elapsed * 1e-9, (elapsed - nestedNanoseconds) * 1e-9, elapsed * 1e-9);
+		// counts for this job, not for the task that started it
+		nestedNanoseconds = outerNested + elapsed;
+		return;
+	}
+
+	shared_ptr<TaskGroup> group = make_shared<TaskGroup>();
+	group->task = &task;
+	group->numTasks = numTasks;
+	group->owner = this->queueIndex();
+	group->parent = static_cast<const TaskGroup*>(currentGroup);
+	this->runGroup(group, phase, start);
+}
+
+void ThreadPool::runOnEachThread(const function<void(size_t)>& task, const string& phase)
+{
+	// inside a task (of any thread, including the caller of the outer job) the other threads may be busy with
+	// the outer job for a long time, stealing is better there
+	if (currentGroup != nullptr || this->workers.empty())
+	{
+		this->run(this->size(), task, phase);
+		return;
+	}
+
+	auto start = chrono::steady_clock::now();
+	shared_ptr<TaskGroup> group = make_shared<TaskGroup>();
+	group->task = &task;
+	group->numTasks = this->size();
+	group->owner = 0;
+	group->bound = true;
+	group->parent = static_cast<const TaskGroup*>(currentGroup);
+	group->claimed.reset(new atomic<bool>[group->numTasks]);
+	for (size_t t = 0; t < group->numTasks; t++)
+		group->claimed[t].store(false);
+	this->runGroup(group, phase, start);
+}
+
+void ThreadPool::runGroup(const shared_ptr<TaskGroup>& group, const string& phase, chrono::steady_clock::time_point start)
+{
+	size_t self = group->owner;
+	size_t numTasks = group->numTasks;
+	{
+		WorkQueue& queue = *this->queues[self];
+		lock_guard<mutex> lock(queue.queueMutex);
+		queue.groups.push_back(group);
+	}
+	this->notifyAll();
+
+	// work on the own tasks first, then help with the tasks nested in them until the stolen tasks are finished
+	while (group->done.load() < numTasks)
+	{
+		size_t seenVersion;
+		{
+			lock_guard<mutex> lock(this->stateMutex);
+			seenVersion = this->version;
+		}
+		if (group->done.load() >= numTasks)
+			break;
+		if (this->runOneTask(self, group.get()))
+			continue;
+
+		unique_lock<mutex> lock(this->stateMutex);
+		this->wakeCondition.wait(lock, [&]() { return this->version != seenVersion || group->done.load() >= numTasks; });
+	}
+
+	double wall = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	this->addStats(phase, numTasks, this->size(), wall, group->busyNanoseconds.load() * 1e-9, group->inclusiveNanoseconds.load() * 1e-9);
+}
+
+void ThreadPool::addStats(const string& phase, size_t tasks, size_t threads, double wallSeconds, double busySeconds, double inclusiveSeconds)
+{
+	lock_guard<mutex> lock(this->statsMutex);
+	auto it = find_if(this->stats.begin(), this->stats.end(), [&](const PhaseStats& s) { return s.phase == phase; });
+	if (it == this->stats.end())
+	{
+		this->stats.push_back(PhaseStats());
+		it = this->stats.end() - 1;
+		it->phase = phase;
+	}
+	it->jobs++;
+	it->tasks += tasks;
+	it->threads = threads;
+	it->wallSeconds += wallSeconds;
+	it->busySeconds += busySeconds;
+	it->inclusiveSeconds += inclusiveSeconds;
+	it->threadSeconds += wallSeconds * threads;
+}
+
+vector<ThreadPool::PhaseStats> ThreadPool::getStats()
+{
+	lock_guard<mutex> lock(this->statsMutex);
+	return this->stats;
+}
+
+void ThreadPool::resetStats()
+{
+	lock_guard<mutex> lock(this->statsMutex);
+	this->stats.clear();
+	this->stolenTasks.store(0);
+}
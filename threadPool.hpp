@@ -0,0 +1,182 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <chrono>
+
+using namespace std;
+
+// Persistent pool of worker threads with a work-stealing fork/join interface
+// The workers are created once and sleep while there is no work, so a parallel phase costs a wake-up
+// instead of creating and joining threads
+// Every thread has its own queue of task groups: a job started by a thread is pushed to its queue and
+// the thread works on it itself, idle threads steal tasks from the oldest groups of the other queues
+// A thread waiting for the stolen tasks of its job helps only with that job and the jobs nested in it,
+// so it never starts an unrelated outer task (e.g. another trial) that would delay the join
+// Jobs can be started from inside a task (e.g. a trial splitting its assignment into chunks),
+// so the cores left idle by the outer job help with the inner ones
+class ThreadPool {
+
+public:
+
+	// Time spent in the jobs of one phase (e.g. the assignment of ParallelKmeans)
+	struct PhaseStats {
+		string phase;
+		size_t jobs = 0;
+		size_t tasks = 0;
+		size_t threads = 0;			// size of the pool in the last job
+		double wallSeconds = 0.0;	// time from the fork to the join
+		double busySeconds = 0.0;	// time spent in the tasks summed over the threads, without the tasks of nested jobs
+		double inclusiveSeconds = 0.0;	// time spent in the tasks including the nested jobs they started
+		double threadSeconds = 0.0;	// wall time multiplied by the number of threads of the job
+
+		// Fraction of the time the threads of the pool spent in the tasks, without the nested jobs
+		// (an outer job such as the trials mostly waits for its nested jobs, so this is low for it)
+		double utilization() const { return (threadSeconds > 0.0) ? busySeconds / threadSeconds : 0.0; };
+
+		// Fraction of the time the threads of the pool spent in the tasks including their nested jobs
+		double inclusiveUtilization() const { return (threadSeconds > 0.0) ? inclusiveSeconds / threadSeconds : 0.0; };
+	};
+
+	// CPUs a thread of the pool is pinned to (not pinned if empty) and their NUMA node
+	struct ThreadPlacement {
+		vector<int> cpus;
+		size_t node = 0;
+	};
+
+	// placement[t] is applied to worker t (thread 0, the caller of run, is not pinned by the pool)
+	explicit ThreadPool(size_t numThreads, vector<ThreadPlacement> placement = {});
+
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Pool shared by all parallel versions, its size is getNumThreads()
+	static ThreadPool& global();
+
+	// Number of threads running the tasks including the calling thread
+	size_t size() const { return this->workers.size() + 1; };
+
+	// Calls task(i) for every i in [0, numTasks) on the threads of the pool and returns when all of them finished
+	// Tasks are taken dynamically, so numTasks may be larger than the size of the pool
+	// While waiting for its stolen tasks the calling thread helps with the other jobs
+	void run(size_t numTasks, const function<void(size_t)>& task, const string& phase = "other");
+
+	// Calls task(t) on thread t for every t in [0, size()), thread 0 is the calling thread
+	// The tasks are never stolen, so a thread processes the same part of the data in every job (e.g. the pages
+	// it touched first on its NUMA node). Called from a task of the pool (on any thread, also on the thread that
+	// started the outer job) it is an ordinary job, because the other threads are busy with the outer job
+	void runOnEachThread(const function<void(size_t)>& task, const string& phase = "other");
+
+	// NUMA node of thread t (0 if the pool is not placed on nodes)
+	size_t nodeOf(size_t t) const { return (t < this->placement.size()) ? this->placement[t].node : 0; };
+
+	// Number of NUMA nodes the threads are placed on
+	size_t numNodes() const { return this->nodes; };
+
+	// True if the pool was created with a placement of its threads
+	bool isPlaced() const { return this->placed; };
+
+	// Number of tasks executed by another thread than the one that started their job
+	size_t getStolenTasks() const { return this->stolenTasks.load(); };
+
+	vector<PhaseStats> getStats();
+
+	void resetStats();
+
+private:
+
+	// Tasks of one job, shared by all threads working on it
+	struct TaskGroup {
+		const function<void(size_t)>* task;
+		size_t numTasks;
+		size_t owner;						// queue of the thread that started the job
+		bool bound = false;					// task t runs only on the thread of queue t (runOnEachThread)
+		const TaskGroup* parent = nullptr;	// group of the task that started the job, null outside the tasks of the pool
+		unique_ptr<atomic<bool>[]> claimed;	// claimed tasks of a bound group
+		atomic<size_t> next{0};				// next task to claim
+		atomic<size_t> done{0};				// finished tasks
+		atomic<long long> busyNanoseconds{0};
+		atomic<long long> inclusiveNanoseconds{0};
+	};
+
+	struct WorkQueue {
+		mutex queueMutex;
+		deque<shared_ptr<TaskGroup>> groups;	// newest at the back
+	};
+
+	vector<thread> workers;
+	vector<unique_ptr<WorkQueue>> queues;	// queue 0 is shared by the threads outside the pool
+	vector<ThreadPlacement> placement;
+	size_t nodes = 1;
+	bool placed = false;
+
+	mutex stateMutex;
+	condition_variable wakeCondition;
+	size_t version = 0;		// incremented when a job is started or finished, wakes the sleeping threads
+	bool stopping = false;
+
+	atomic<size_t> stolenTasks{0};
+
+	mutex statsMutex;
+	vector<PhaseStats> stats;
+
+	void workerLoop(size_t index);
+
+	// Pushes the group to the queue of its owner and works on it until all its tasks are finished
+	void runGroup(const shared_ptr<TaskGroup>& group, const string& phase, chrono::steady_clock::time_point start);
+
+	// Queue of the calling thread
+	size_t queueIndex() const;
+
+	// True if the thread of queue self can claim a task of the group
+	// With within set only the group within, the groups nested in it and the bound groups qualify
+	// (the task of a bound group cannot run on another thread, so it is never deferred)
+	static bool claimable(const TaskGroup& group, size_t self, const TaskGroup* within = nullptr);
+
+	// Returns a group with unclaimed tasks: the newest one of the own queue or the oldest one of another queue
+	shared_ptr<TaskGroup> findWork(size_t self, const TaskGroup* within = nullptr);
+
+	// Claims and runs one task of any group (see claimable), returns false if there was no work
+	bool runOneTask(size_t self, const TaskGroup* within = nullptr);
+
+	void notifyAll();
+
+	void addStats(const string& phase, size_t tasks, size_t threads, double wallSeconds, double busySeconds, double inclusiveSeconds);
+};
+
+// Number of threads used by every parallel version (the size of the global pool)
+// 0 selects the threads usable under the affinity mask and the cgroup quota (see cpuTopology)
+// Must not be called while a parallel version is running, the global pool is recreated with the new size
+void setNumThreads(size_t numThreads);
+
+size_t getNumThreads();
+
+// Pinning of the threads of the global pool to single CPUs
+enum class AffinityPolicy {
+	None,		// threads are not pinned (only to their nodes in the NUMA mode)
+	Compact,	// consecutive threads on neighbouring CPUs: SMT siblings first, then the cores of a package and node
+	Scatter,	// consecutive threads on different packages, then different cores, SMT siblings last
+	List		// thread t on the t-th CPU of an explicit list (cyclically)
+};
+
+// Sets the affinity policy of the global pool, cpus is the list of the List policy
+// A pinned pool keeps range t of every parallel pass on thread t, so a thread re-reads the same cached part
+// of the points in every iteration. The calling thread is pinned as thread 0
+// Must not be called while a parallel version is running, the global pool is recreated
+void setAffinityPolicy(AffinityPolicy policy, vector<int> cpus = {});
+
+// NUMA mode of the global pool: thread t is pinned to the CPUs of node t * nodes / size, so every node gets
+// a contiguous block of threads, and ParallelKmeans keeps the shard of every thread on the thread (see
+// placeOnNumaNodes). The calling thread is pinned to the first node, as it runs the tasks of thread 0
+// Must not be called while a parallel version is running, the global pool is recreated
+void setNumaMode(bool enabled);
+
+bool getNumaMode();
@@ -0,0 +1,277 @@
+#include "yinyangKmeans.hpp"
+
+YinyangKmeans::YinyangKmeans(Dataset data, size_t k, vector<PointKmeans> centroids, size_t maxIter, size_t numberOfGroups)
+: Kmeans(data, k, maxIter)
+{
+	this->centroids = centroids;
+	this->numberOfGroups = numberOfGroups;
+	if (this->numberOfGroups == 0)
+		this->numberOfGroups = max<size_t>(1, k / 10);
+	this->numberOfGroups = min(this->numberOfGroups, k);
+}
+
+pair<vector<PointKmeans>, vector<vector<PointKmeans>>> YinyangKmeans::k_means()
+{
+	KmeansLabelResult res = this->k_meansLabels();
+	if (!res.converged)
+		return {vector<PointKmeans>(), vector<vector<PointKmeans>>()};
+
+	return {res.centroids, this->clustersFromLabels(res.labels)};
+}
+
+void YinyangKmeans::groupCentroids(const PointStore& centroids)
+{
+	size_t t = this->numberOfGroups;
+
+	// centers of the groups start at centroids spread over the whole array
+	PointStore groupCenters;
+	groupCenters.reserve(t);
+	for (size_t g = 0; g < t; g++)
+	{
+		size_t j = g * this->k / t;
+		groupCenters.push_back(centroids.xData()[j], centroids.yData()[j]);
+	}
+
+	// a few iterations of kmeans over the centroids are enough for the grouping
+	vector<uint32_t> labels(this->k);
+	ClusterSums sums(t);
+	for (size_t iter = 0; iter < 5; iter++)
+	{
+		sums.reset();
+		assignToNearestCentroid(centroids, 0, this->k, groupCenters, labels.data(), nullptr, &sums);
+		if (updateCentroids(sums, groupCenters))
+			break;
+	}
+
+	this->groupOf.assign(this->k, 0);
+	this->groups.assign(t, vector<size_t>());
+	for (size_t j = 0; j < this->k; j++)
+	{
+		this->groupOf[j] = labels[j];
+		this->groups[labels[j]].push_back(j);
+	}
+}
+
+void YinyangKmeans::forEachPart(const function<void(size_t, size_t, size_t)>& f)
+{
+	f(0, 0, this->store.size());
+}
+
+size_t YinyangKmeans::assignPart(size_t begin,
+									size_t end,
+									const PointStore& centroids,
+									const vector<double>& shift,
+									const vector<double>& groupShift,
+									bool first,
+									LabelArray& labels,
+									ClusterSums& sums)
+{
+	const double* x = this->store->xData();
+	const double* y = this->store->yData();
+	const double* cx = centroids.xData();
+	const double* cy = centroids.yData();
+	size_t t = this->numberOfGroups;
+	size_t evaluations = 0;
+
+	vector<double> value(this->k);	// distance or lower bound of the distance to every centroid of the examined groups
+	vector<char> examined(t);
+
+	auto dist = [&](size_t i, size_t j) {
+		double dx = x[i] - cx[j];
+		double dy = y[i] - cy[j];
+		evaluations++;
+		return sqrt(dx * dx + dy * dy);
+	};
+
+	sums.reset();
+	for (size_t i = begin; i < end; i++)
+	{
+		double* lb = &this->lower[i * t];
+		size_t a = labels[i];
+
+		if (first)
+		{
+			// compute distance to each centroid and select the minimal one
+			size_t best = 0;
+			for (size_t j = 0; j < this->k; j++)
+			{
+				value[j] = dist(i, j);
+				if (value[j] < value[best])
+					best = j;
+			}
+			fill(lb, lb + t, numeric_limits<double>::max());
+			for (size_t j = 0; j < this->k; j++)
+			{
+				if (j != best)
+					lb[this->groupOf[j]] = min(lb[this->groupOf[j]], value[j]);
+			}
+			a = best;
+			this->upper[i] = value[best];
+			labels.set(i, a);
+		}
+		else
+		{
+			// move the bounds by the shift of the centroids
+			this->upper[i] += shift[a];
+			double globalLower = numeric_limits<double>::max();
+			for (size_t g = 0; g < t; g++)
+			{
+				lb[g] -= groupShift[g];
+				globalLower = min(globalLower, lb[g]);
+			}
+
+			// global filtering - no centroid can be closer than the assigned one
+			bool skip = this->upper[i] <= globalLower;
+			if (!skip)
+			{
+				this->upper[i] = dist(i, a);
+				skip = this->upper[i] <= globalLower;
+			}
+
+			if (!skip)
+			{
+				size_t best = a;
+				double bestDist = this->upper[i];
+
+				for (size_t g = 0; g < t; g++)
+				{
+					// group filtering - all centroids of the group are further than the best one
+					examined[g] = lb[g] < bestDist;
+					if (!examined[g])
+						continue;
+
+					double previousBound = lb[g] + groupShift[g];
+					for (size_t j : this->groups[g])
+					{
+						if (j == a)
+						{
+							value[j] = this->upper[i];
+							continue;
+						}
+
+						// local filtering - the centroid was further than the group bound before it moved
+						double localBound = previousBound - shift[j];
+						if (localBound >= bestDist)
+						{
+							value[j] = localBound;
+							continue;
+						}
+
+						value[j] = dist(i, j);
+						if (value[j] < bestDist || (value[j] == bestDist && j < best))
+						{
+							best = j;
+							bestDist = value[j];
+						}
+					}
+				}
+
+				// new bounds of the examined groups exclude the new centroid
+				for (size_t g = 0; g < t; g++)
+				{
+					if (!examined[g])
+						continue;
+					lb[g] = numeric_limits<double>::max();
+					for (size_t j : this->groups[g])
+					{
+						if (j != best)
+							lb[g] = min(lb[g], value[j]);
+					}
+				}
+				// the previous centroid is now one of the other centroids of its group
+				if (best != a && !examined[this->groupOf[a]])
+					lb[this->groupOf[a]] = min(lb[this->groupOf[a]], this->upper[i]);
+
+				a = best;
+				this->upper[i] = bestDist;
+				labels.set(i, a);
+			}
+		}
+
+		sums.sumX[a] += x[i];
+		sums.sumY[a] += y[i];
+		sums.count[a]++;
+	}
+	return evaluations;
+}
+
+KmeansLabelResult YinyangKmeans::k_meansLabels()
+{
+	this->requireUnweighted("Yinyang");
+
+	// initialize Centroids from given points
+	if (this->centroids.empty())
+		this->initializeCentroids();
+
+	size_t n = this->store.size();
+	size_t k = this->k;
+	size_t t = this->numberOfGroups;
+	size_t parts = this->numberOfParts();
+
+	KmeansLabelResult res;
+	res.labels = LabelArray(n, k);
+	res.sums = ClusterSums(k);
+	PointStore centroidStore(this->centroids);
+	PointStore oldCentroids(this->centroids);
+
+	this->groupCentroids(centroidStore);
+	this->upper.assign(n, 0.0);
+	this->lower.assign(n * t, 0.0);
+	vector<double> shift(k, 0.0);		// how far each centroid moved in the last update
+	vector<double> groupShift(t, 0.0);	// the largest shift in every group
+	vector<ClusterSums> partSums(parts, ClusterSums(k));
+	vector<size_t> partEvaluations(parts, 0);
+
+	for (size_t iter = 0; iter < this->maxIter && !res.converged; iter++)
+	{
+		// assign each point to a cluster, skipping the points and centroids excluded by the bounds
+		bool first = iter == 0;
+		this->forEachPart([&](size_t part, size_t begin, size_t end) {
+			partEvaluations[part] = this->assignPart(begin, end, centroidStore, shift, groupShift, first, res.labels, partSums[part]);
+		});
+
+		res.sums.reset();
+		for (size_t part = 0; part < parts; part++)
+		{
+			res.sums.add(partSums[part]);
+			res.distanceEvaluations += partEvaluations[part];
+		}
+
+		// calculate new centroids and check if they are same as the previous centroids
+		copy(centroidStore.xData(), centroidStore.xData() + k, oldCentroids.xData());
+		copy(centroidStore.yData(), centroidStore.yData() + k, oldCentroids.yData());
+		res.converged = updateCentroids(res.sums, centroidStore);
+		res.iterations = iter + 1;
+
+		// shifts of the centroids and groups, the bounds are moved at the start of the next assignment
+		fill(groupShift.begin(), groupShift.end(), 0.0);
+		for (size_t j = 0; j < k; j++)
+		{
+			double dx = centroidStore.xData()[j] - oldCentroids.xData()[j];
+			double dy = centroidStore.yData()[j] - oldCentroids.yData()[j];
+			shift[j] = sqrt(dx * dx + dy * dy);
+			groupShift[this->groupOf[j]] = max(groupShift[this->groupOf[j]], shift[j]);
+		}
+	}
+
+	if (!res.converged)
+		cout << "Yinyang did not converge." << endl;
+
+	// sum of squared distances to the centroids of the last assignment
+	this->sqDist = sumOfSquaredDistances(*this->store, res.labels, oldCentroids);
+
+	this->centroids = centroidStore.toPoints();
+	res.centroids = this->centroids;
+	res.sqDist = this->sqDist;
+	return res;
+}
+
+size_t ParallelYinyangKmeans::numberOfParts()
+{
+	return getNumThreads();
+}
+
+void ParallelYinyangKmeans::forEachPart(const function<void(size_t, size_t, size_t)>& f)
+{
+	parallelForRanges(this->store.size(), this->numberOfParts(), f, "yinyang");
+}
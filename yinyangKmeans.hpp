@@ -0,0 +1,71 @@
+#pragma once
+#include <vector>
+#include <functional>
+
+#include "kmeans.hpp"
+
+using namespace std;
+
+// Kmeans accelerated with grouped centroids (Yinyang kmeans, Ding et al., 2015)
+// The centroids are clustered into groups once at the start. Every point keeps an upper bound
+// on the distance to its centroid and one lower bound per group
+// Global filtering skips a point whose upper bound is below all group bounds,
+// group filtering skips whole groups, local filtering skips single centroids of the remaining groups
+// Memory is O(n*k/10) and the pruning keeps working for k in the hundreds or thousands
+class YinyangKmeans : public Kmeans {
+
+public:
+
+	// Takes the initial centroids the same way as ParallelKmeans
+	// numberOfGroups = 0 selects k/10 groups
+	YinyangKmeans(Dataset data, size_t k, vector<PointKmeans> centroids, size_t maxIter = 1'000, size_t numberOfGroups = 0);
+
+	pair<vector<PointKmeans>, vector<vector<PointKmeans>>> k_means() override;
+
+	KmeansLabelResult k_meansLabels() override;
+
+protected:
+
+	size_t numberOfGroups;
+	vector<size_t> groupOf;			// group of every centroid
+	vector<vector<size_t>> groups;	// centroids in every group
+	vector<double> upper;
+	vector<double> lower;			// numberOfGroups lower bounds per point
+
+	// Clusters the initial centroids into groups by a few iterations of kmeans
+	void groupCentroids(const PointStore& centroids);
+
+	// Number of parts the points are split into, each part has its own sums
+	virtual size_t numberOfParts() { return 1; };
+
+	// Calls f(part, begin, end) for every part of the points
+	virtual void forEachPart(const function<void(size_t, size_t, size_t)>& f);
+
+	// Assigns points [begin, end) to their nearest centroid and adds them to sums
+	// shift and groupShift are the moves of the centroids and groups in the last update
+	// Returns the number of computed distances
+	size_t assignPart(size_t begin,
+						size_t end,
+						const PointStore& centroids,
+						const vector<double>& shift,
+						const vector<double>& groupShift,
+						bool first,
+						LabelArray& labels,
+						ClusterSums& sums);
+};
+
+// Multi-threaded version of YinyangKmeans
+// Points are split between threads the same way as in ParallelKmeans, every thread keeps its own cluster sums
+class ParallelYinyangKmeans : public YinyangKmeans {
+
+public:
+
+	ParallelYinyangKmeans(Dataset data, size_t k, vector<PointKmeans> centroids, size_t maxIter = 1'000, size_t numberOfGroups = 0)
+	: YinyangKmeans(data, k, centroids, maxIter, numberOfGroups) {};
+
+protected:
+
+	size_t numberOfParts() override;
+
+	void forEachPart(const function<void(size_t, size_t, size_t)>& f) override;
+};